@@ -0,0 +1,141 @@
+#include "BatchRunner.h"
+
+#include <stdexcept>
+#include <thread>
+#include <mutex>
+#include <exception>
+
+#include "ThreadPool.h"
+#include "Timing.h"
+
+
+BatchRunner::BatchRunner(const ExperimentConfig& config, int threads) : mConfig(batchConfig(config)), mThreads(threadCount(threads))
+{
+}
+
+int BatchRunner::threadCount(int threads) {
+	if (threads < 0)
+		throw std::invalid_argument("Threads should be positive or 0");
+
+	if (threads == 0)
+		threads = (int)std::thread::hardware_concurrency();
+
+	return (threads < 1) ? 1 : threads;
+}
+
+ExperimentConfig BatchRunner::batchConfig(const ExperimentConfig& config) {
+	ExperimentConfig batch = config;
+
+	// the experiments are spread over the cores, so every solver evaluates on a single thread
+	batch.options.threads = 1;
+
+	// experiment n is seeded with seed + n - 1, so the batch needs a fixed base seed
+	if (batch.options.seed == 0)
+		batch.options.seed = (uint64_t)timeNow().time_since_epoch().count();
+
+	// the experiments run one after the other on a thread, and the table of the target would be built again for every
+	// one of them once the one before has let it go (a target the table cannot serve is left to the solvers to reject)
+	if (batch.options.fitnessTable && !batch.options.sharedTable && batch.options.productMode == PRODUCT_INT64 &&
+		!batch.options.productCutoff && batch.cards >= 2 && batch.cards <= MAX_TABLE_CARDS && batch.sum >= 0 && batch.prod >= 0)
+		batch.options.sharedTable = FitnessTable::get(batch.sum, batch.prod, batch.cards, batch.options.fitnessTableCache);
+
+	return batch;
+}
+
+RunResult BatchRunner::runExperiment(const ExperimentConfig& config, int experiment, bool samePopulation) {
+
+	GAOptions options = config.options;
+
+	options.seed = config.options.seed + experiment - 1;
+	if (samePopulation && options.populationSeed == 0)
+		options.populationSeed = config.options.seed;
+
+	// every experiment has its own checkpoint
+	if (!options.checkpointPath.empty())
+		options.checkpointPath += "." + std::to_string(experiment);
+
+	TimeVar now = timeNow();
+
+	CardGenAlgo cga = CardGenAlgo(config.sum, config.prod, config.cards, config.popSize, config.pXOver, config.pMutation,
+		config.maxGenerations, OUTPUT_NONE, config.maxGenerations, options);
+	cga.advanceToFinalGeneration();
+
+	RunResult result = cga.getResult();
+	result.experiment = experiment;
+	result.wallTimeMs = durationMs(timeNow() - now);
+
+	return result;
+}
+
+BatchReport BatchRunner::run(int experiments, bool samePopulation) const {
+
+	BatchReport report = BatchReport();
+	ThreadPool pool(mThreads < experiments ? mThreads : experiments);
+	std::exception_ptr error;
+	std::mutex errorMutex;
+
+	report.runs.resize(experiments);
+
+	TimeVar now = timeNow();
+
+	pool.run(experiments, [&](int i) {
+		try {
+			report.runs[i] = runExperiment(mConfig, i + 1, samePopulation);
+		}
+		catch (...) {
+			// handed to the caller once every thread is done
+			std::lock_guard<std::mutex> lock(errorMutex);
+			if (!error)
+				error = std::current_exception();
+		}
+	});
+
+	if (error)
+		std::rethrow_exception(error);
+
+	report.totalWallTimeMs = durationMs(timeNow() - now);
+	summarize(report);
+
+	return report;
+}
+
+void BatchRunner::summarize(BatchReport& report) {
+
+	int experiments = (int)report.runs.size();
+
+	report.solvedRuns = report.stoppedRuns = 0;
+	report.avgGenerations = report.avgEvaluations = report.avgBestFitness = report.avgWallTimeMs = 0;
+
+	for (int i = 0; i < experiments; ++i) {
+		if (report.runs[i].solved)
+			report.solvedRuns++;
+		else if (report.runs[i].stopReason != STOP_NONE && report.runs[i].stopReason != STOP_MAX_GENERATIONS)
+			report.stoppedRuns++;
+		report.avgGenerations += report.runs[i].generations;
+		report.avgEvaluations += (double)report.runs[i].evaluations;
+		report.avgBestFitness += report.runs[i].best.fitness;
+		report.avgWallTimeMs += report.runs[i].wallTimeMs;
+	}
+
+	if (experiments > 0) {
+		report.avgGenerations /= experiments;
+		report.avgEvaluations /= experiments;
+		report.avgBestFitness /= experiments;
+		report.avgWallTimeMs /= experiments;
+	}
+}
+
+void BatchRunner::writeReport(const BatchReport& report, std::ostream& out) {
+
+	out << "Exp Seed Generations Solved BestGenoSum BestGenoProd BestGenoFitness WallTimeMs PXOver PMutation Evaluations Stop\n";
+	for (size_t i = 0; i < report.runs.size(); ++i) {
+		const RunResult& run = report.runs[i];
+		out << run.experiment << " " << run.seed << " " << run.generations << " " << (run.solved ? 1 : 0) << " "
+			<< run.best.sum << " " << run.best.product << " " << run.best.fitness << " " << run.wallTimeMs << " " << run.pXOver << " " << run.pMutation << " "
+			<< run.evaluations << " " << getStopReasonName(run.stopReason) << "\n";
+	}
+
+	out << "# experiments: " << report.runs.size() << ", solved: " << report.solvedRuns << ", stopped early: " << report.stoppedRuns
+		<< ", avg generations: " << report.avgGenerations << ", avg evaluations: " << report.avgEvaluations << ", avg best fitness: " << report.avgBestFitness
+		<< ", avg time: " << report.avgWallTimeMs << " ms, total time: " << report.totalWallTimeMs << " ms\n";
+}
@@ -0,0 +1,69 @@
+#pragma once
+
+#include <vector>
+#include <ostream>
+
+#include "CardGenAlgo.h"
+
+using std::vector;
+
+// the problem and the parameters of the algorithm for every experiment of a batch
+struct ExperimentConfig
+{
+	int sum;
+	int64_t prod;
+	int cards;
+	int popSize;
+	double pXOver, pMutation;
+	int maxGenerations;
+	GAOptions options;
+
+	// the default problem (Target sum: 36, Target Product: 360, Cards: 1-10)
+	ExperimentConfig() : sum(36), prod(360), cards(10), popSize(100), pXOver(0.6), pMutation(0.01), maxGenerations(1000) {}
+};
+
+// the merged results of a batch
+struct BatchReport
+{
+	vector<RunResult> runs;  // one per experiment, in experiment order
+	int solvedRuns;
+	int stoppedRuns;         // the runs a stop criterion of the options ended early (see StopReason)
+	double avgGenerations;
+	double avgEvaluations;
+	double avgBestFitness;
+	double avgWallTimeMs;
+	double totalWallTimeMs;  // the time the whole batch took
+
+	BatchReport() : solvedRuns(0), stoppedRuns(0), avgGenerations(0), avgEvaluations(0), avgBestFitness(0), avgWallTimeMs(0), totalWallTimeMs(0) {}
+};
+
+class BatchRunner {
+  /*
+   * Runs a batch of independent experiments concurrently, every one of them on its own solver
+   * (and so with its own random generator), and merges their results.
+   */
+
+private:
+	ExperimentConfig mConfig;
+	int mThreads;
+
+public:
+	// threads is the number of experiments that run at the same time (0 uses every core)
+	BatchRunner(const ExperimentConfig& config, int threads);
+
+	// run experiments 1..experiments, with the same initial population in each one if samePopulation
+	BatchReport run(int experiments, bool samePopulation) const;
+
+	// write the per experiment results and the averages
+	static void writeReport(const BatchReport& report, std::ostream& out);
+
+	// the threads to use for a requested count (0 is every core)
+	static int threadCount(int threads);
+	// the config the experiments of a batch run with: solvers on a single thread, a fixed base seed and the fitness table
+	// (with fitnessTable) held for the whole batch
+	static ExperimentConfig batchConfig(const ExperimentConfig& config);
+	// run experiment n of a batch of config (as returned by batchConfig)
+	static RunResult runExperiment(const ExperimentConfig& config, int experiment, bool samePopulation);
+	// fill in the totals and averages of a report from its runs
+	static void summarize(BatchReport& report);
+};
@@ -0,0 +1,184 @@
+#include "EvalKernel.h"
+
+#if (defined(__GNUC__) || defined(__clang__)) && (defined(__x86_64__) || defined(__i386__))
+#define EVAL_KERNEL_X86
+// gcc 12 warns about the undefined placeholder vectors inside its own avx512 intrinsics
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wmaybe-uninitialized"
+#include <immintrin.h>
+#endif
+
+
+void evalKernelScalar(const uint64_t* genes, int n, int cards, int* sum, int64_t* product) {
+
+	for (int i = 0; i < n; ++i) {
+		uint64_t g = genes[i];
+		int s = 0;
+		int64_t p = 1;
+
+		// for every gene (without branches, the genes are random so they would be mispredicted half the time)
+		for (int j = 0; j < cards; ++j) {
+			int bit = (int)((g >> j) & 1);
+			s += (1 - bit) * (j + 1);    // if the card in the first stack we add
+			p *= 1 + bit * j;            // if it is in the second one we multiply
+		}
+
+		// no card in the second stack
+		sum[i] = s;
+		product[i] = (g == 0) ? 0 : p;
+	}
+}
+
+// the sums and products of the cards of each byte of a genome, built at compile time: entry [b][v] is for the cards
+// 8b+1..8b+8 whose bits are set in v (every product fits, the largest is 57*58*...*64 < 2^48)
+struct ByteTables
+{
+	int sum[8][256];
+	int64_t product[8][256];
+
+	constexpr ByteTables() : sum(), product() {
+		for (int b = 0; b < 8; ++b) {
+			int top = 0;
+			sum[b][0] = 0;
+			product[b][0] = 1;
+
+			// a byte is the byte without its top bit plus the card of that bit
+			for (int v = 1; v < 256; ++v) {
+				if (v == 2 << top || v == 1)
+					top = (v == 1) ? 0 : top + 1;
+				sum[b][v] = sum[b][v - (1 << top)] + 8 * b + top + 1;
+				product[b][v] = product[b][v - (1 << top)] * (8 * b + top + 1);
+			}
+		}
+	}
+};
+
+static constexpr ByteTables BYTE_TABLES = ByteTables();
+
+// p * q, or INT64_MAX if it does not fit (p, q > 0)
+static inline int64_t multiplySaturated(int64_t p, int64_t q) {
+#ifdef __SIZEOF_INT128__
+	// one widening multiply and a conditional move, no branch
+	unsigned __int128 r = (unsigned __int128)p * (uint64_t)q;
+	return (r > (unsigned __int128)INT64_MAX) ? INT64_MAX : (int64_t)r;
+#else
+	return (p > INT64_MAX / q) ? INT64_MAX : p * q;
+#endif
+}
+
+// the sum and product of bytes 0..B-1 of a genome, unrolled by the recursion (no compiler unrolls loops the same way)
+template <int B, bool SATURATE>
+struct ByteLookup
+{
+	static inline void add(uint64_t g, int& s, int64_t& p) {
+		ByteLookup<B - 1, SATURATE>::add(g, s, p);
+
+		unsigned v = (unsigned)(g >> (8 * (B - 1))) & 255;
+		s += BYTE_TABLES.sum[B - 1][v];
+		p = SATURATE ? multiplySaturated(p, BYTE_TABLES.product[B - 1][v]) : p * BYTE_TABLES.product[B - 1][v];
+	}
+};
+
+template <bool SATURATE>
+struct ByteLookup<0, SATURATE>
+{
+	static inline void add(uint64_t, int&, int64_t&) {}
+};
+
+// a table lookup per byte of the genome instead of a step per card, with the byte count fixed at compile time
+// (the genes past the card range are 0, so cards only changes the total of the sum); the products saturate past MAX_EXACT_CARDS
+template <int BYTES, bool SATURATE>
+static void evalKernelFixed(const uint64_t* genes, int n, int cards, int* sum, int64_t* product) {
+
+	const int total = cards * (cards + 1) / 2;
+
+	for (int i = 0; i < n; ++i) {
+		uint64_t g = genes[i];
+		int s = 0;
+		int64_t p = 1;
+
+		ByteLookup<BYTES, SATURATE>::add(g, s, p);
+
+		// the table sums the cards of the second stack
+		sum[i] = total - s;
+		product[i] = (g == 0) ? 0 : p;
+	}
+}
+
+// by the bytes of the card range, 20 cards (3 bytes) is the last one with exact products
+static const EvalKernel EXACT_KERNELS[3] = { evalKernelFixed<1, false>, evalKernelFixed<2, false>, evalKernelFixed<3, false> };
+static const EvalKernel SATURATED_KERNELS[8] = {
+	nullptr, nullptr, evalKernelFixed<3, true>, evalKernelFixed<4, true>,
+	evalKernelFixed<5, true>, evalKernelFixed<6, true>, evalKernelFixed<7, true>, evalKernelFixed<8, true>
+};
+
+EvalKernel getFixedEvalKernel(int cards) {
+	int bytes = (cards + 7) / 8;
+	return (cards <= MAX_EXACT_CARDS) ? EXACT_KERNELS[bytes - 1] : SATURATED_KERNELS[bytes - 1];
+}
+
+#ifdef EVAL_KERNEL_X86
+
+// 16 genomes at a time in 32 bit lanes, with mask registers instead of blends
+__attribute__((target("avx512f")))
+static void evalKernelAvx512(const uint64_t* genes, int n, int cards, int* sum, int64_t* product) {
+
+	const __m512i one = _mm512_set1_epi32(1);
+	int i = 0;
+
+	for (; i + 16 <= n; i += 16) {
+		// the cards fit in the low half of each word
+		__m256i a = _mm512_cvtepi64_epi32(_mm512_loadu_si512((const void*)(genes + i)));
+		__m256i b = _mm512_cvtepi64_epi32(_mm512_loadu_si512((const void*)(genes + i + 8)));
+		__m512i g = _mm512_inserti64x4(_mm512_castsi256_si512(a), b, 1);
+
+		__m512i s = _mm512_setzero_si512(), p = one;
+		__m512i bits = g;
+
+		for (int j = 0; j < cards; ++j) {
+			__m512i card = _mm512_set1_epi32(j + 1);
+			__mmask16 inProduct = _mm512_test_epi32_mask(bits, one);
+
+			s = _mm512_mask_add_epi32(s, (__mmask16)~inProduct, s, card);
+			p = _mm512_mask_mullo_epi32(p, inProduct, p, card);
+			bits = _mm512_srli_epi32(bits, 1);
+		}
+
+		p = _mm512_maskz_mov_epi32(_mm512_test_epi32_mask(g, g), p);
+
+		// the products are widened to 64 bits on the way out
+		_mm512_storeu_si512((void*)(sum + i), s);
+		_mm512_storeu_si512((void*)(product + i), _mm512_cvtepi32_epi64(_mm512_castsi512_si256(p)));
+		_mm512_storeu_si512((void*)(product + i + 8), _mm512_cvtepi32_epi64(_mm512_extracti64x4_epi64(p, 1)));
+	}
+
+	// the upper halves of the vector registers are cleared before the scalar code runs, otherwise every SSE instruction
+	// after the kernel (log() in the geometric mutation among them) pays a transition penalty
+	_mm256_zeroupper();
+
+	evalKernelScalar(genes + i, n - i, cards, sum + i, product + i);
+}
+
+#pragma GCC diagnostic pop
+#endif
+
+EvalKernel getEvalKernel(int cards, bool vectorize) {
+#ifdef EVAL_KERNEL_X86
+	// the table kernel beats the avx2 version of the loop over the cards and ties with the avx512 one over a whole run,
+	// so the avx512 one is only used when asked for
+	if (vectorize && cards <= MAX_SIMD_CARDS) {
+		__builtin_cpu_init();
+		if (__builtin_cpu_supports("avx512f"))
+			return evalKernelAvx512;
+	}
+#endif
+	return getFixedEvalKernel(cards);
+}
+
+const char* getEvalKernelName(int cards, bool vectorize) {
+#ifdef EVAL_KERNEL_X86
+	if (getEvalKernel(cards, vectorize) == evalKernelAvx512)
+		return "avx512";
+#endif
+	return "table";
+}
@@ -0,0 +1,28 @@
+#pragma once
+
+#include <cstdint>
+
+// Computes, for each of n packed genomes of the given card range, the sum of the cards in the first stack
+// and the product of the cards in the second (0 if the second stack is empty).
+// The products are exact up to MAX_EXACT_CARDS cards and saturate at INT64_MAX past it.
+typedef void (*EvalKernel)(const uint64_t* genes, int n, int cards, int* sum, int64_t* product);
+
+// 20! is the largest factorial that fits in an int64_t
+const int MAX_EXACT_CARDS = 20;
+
+// 12! is the largest factorial that fits in the 32 bit lanes of the SIMD kernels
+const int MAX_SIMD_CARDS = 12;
+
+// the plain C++ version, a step per card (up to MAX_EXACT_CARDS), every other kernel gives the exact same results
+void evalKernelScalar(const uint64_t* genes, int n, int cards, int* sum, int64_t* product);
+
+// the kernel specialized for the bytes the card range takes up, with the sums and products of every byte in tables
+// built at compile time (up to MAX_CARDS cards, past MAX_EXACT_CARDS the products saturate at INT64_MAX)
+EvalKernel getFixedEvalKernel(int cards);
+
+// the kernel for the card range: a SIMD one if vectorize is set and the CPU supports it (checked at run time), the table
+// one otherwise
+EvalKernel getEvalKernel(int cards, bool vectorize);
+
+// the name of the kernel getEvalKernel() would pick ("table" or "avx512")
+const char* getEvalKernelName(int cards, bool vectorize);
@@ -0,0 +1,101 @@
+#include "ExactSolver.h"
+
+#include <algorithm>
+#include <stdexcept>
+
+#include "Timing.h"
+
+
+ExactSolver::ExactSolver(int sum, int64_t prod, int totalCards) : mTargetSum(sum), mTargetProd(prod), mTargetCards(totalCards)
+{
+	if (mTargetSum < 0 || mTargetProd < 0 || mTargetCards < 2)
+		throw std::invalid_argument("Target sum, product should be positive or 0 and cards should be at least 2");
+
+	if (mTargetCards > MAX_CARDS)
+		throw std::invalid_argument("Cards should be at most 64");
+}
+
+// every subset of the cards [card,toCard] added to the partial one, that keeps its sum within maxSum and its product a divisor of the target
+void ExactSolver::enumerate(int fromCard, int toCard, int card, int sum, int64_t product, GeneWord genes, int maxSum, vector<Partial>& out) const {
+
+	if (card > toCard) {
+		Partial partial = { sum, product, genes };
+		out.push_back(partial);
+		return;
+	}
+
+	// the card in the first stack
+	enumerate(fromCard, toCard, card + 1, sum, product, genes, maxSum, out);
+
+	// the card in the second stack
+	if (sum + card <= maxSum && product <= mTargetProd / card && mTargetProd % (product * card) == 0)
+		enumerate(fromCard, toCard, card + 1, sum + card, product * card, genes | ((GeneWord)1 << (card - 1)), maxSum, out);
+}
+
+vector<GeneWord> ExactSolver::solveAll(size_t limit) const {
+
+	vector<GeneWord> solutions;
+	int totalSum = mTargetCards * (mTargetCards + 1) / 2;
+
+	// the cards of the second stack add up to the rest
+	int secondSum = totalSum - mTargetSum;
+	if (secondSum < 0)
+		return solutions;
+
+	// a product of 0 is an empty second stack
+	if (mTargetProd == 0) {
+		if (secondSum == 0)
+			solutions.push_back(0);
+		return solutions;
+	}
+
+	int half = mTargetCards / 2;
+	vector<Partial> low, high;
+
+	enumerate(1, half, 1, 0, 1, 0, secondSum, low);
+	enumerate(half + 1, mTargetCards, half + 1, 0, 1, 0, secondSum, high);
+
+	std::sort(low.begin(), low.end());
+
+	for (size_t i = 0; i < high.size(); ++i) {
+		// the low part that completes this high one
+		Partial wanted = { secondSum - high[i].sum, mTargetProd / high[i].product, 0 };
+		std::pair<vector<Partial>::iterator, vector<Partial>::iterator> match = std::equal_range(low.begin(), low.end(), wanted);
+
+		for (vector<Partial>::iterator it = match.first; it != match.second; ++it) {
+			GeneWord genes = it->genes | high[i].genes;
+
+			// the empty second stack has a product of 0, not 1
+			if (genes == 0)
+				continue;
+
+			solutions.push_back(genes);
+			if (limit != 0 && solutions.size() >= limit) {
+				std::sort(solutions.begin(), solutions.end());
+				return solutions;
+			}
+		}
+	}
+
+	std::sort(solutions.begin(), solutions.end());
+	return solutions;
+}
+
+RunResult ExactSolver::solve() const {
+
+	RunResult result;
+	TimeVar now = timeNow();
+
+	vector<GeneWord> solutions = solveAll(1);
+
+	result.solved = !solutions.empty();
+	if (result.solved) {
+		result.best.Genes = solutions[0];
+		result.best.sum = mTargetSum;
+		result.best.product = mTargetProd;
+		result.best.fitness = 1;
+	}
+
+	result.wallTimeMs = durationMs(timeNow() - now);
+	return result;
+}
@@ -0,0 +1,48 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include "CardGenAlgo.h"
+
+using std::vector;
+
+class ExactSolver {
+  /*
+   * Finds every exact solution of a (sum, product, cards) problem, or proves there is none, by meeting in the middle:
+   * the subsets of the low and of the high half of the cards that could be part of the second stack are enumerated
+   * (a subset whose product does not divide the target, or whose sum is too large, is cut off with all its supersets),
+   * the low ones are sorted by (sum, product) and every high one is joined with the low ones that complete it.
+   * Practical up to about 40 cards, answers in milliseconds for the usual targets.
+   */
+
+private:
+	// a subset of one half of the cards in the second stack
+	struct Partial {
+		int sum;
+		int64_t product;
+		GeneWord genes;
+
+		bool operator<(const Partial& other) const {
+			return sum < other.sum || (sum == other.sum && product < other.product);
+		}
+	};
+
+	int mTargetSum;
+	int64_t mTargetProd;
+	int mTargetCards;
+
+	void enumerate(int fromCard, int toCard, int card, int sum, int64_t product, GeneWord genes, int maxSum, vector<Partial>& out) const;
+
+public:
+	ExactSolver(int sum, int64_t prod, int totalCards);
+
+	// every solution, packed as in Genotype (at most limit of them, 0 for all)
+	vector<GeneWord> solveAll(size_t limit = 0) const;
+
+	// the first solution as the result of a run (not solved if there is none), timed
+	RunResult solve() const;
+
+	// if the problem has a solution at all
+	bool hasSolution() const { return !solveAll(1).empty(); }
+};
@@ -0,0 +1,196 @@
+#include "FitnessTable.h"
+#include "ThreadPool.h"
+
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <limits>
+#include <map>
+#include <mutex>
+#include <sstream>
+#include <stdexcept>
+#include <thread>
+#include <tuple>
+
+// the smallest distance of a genome that is not a solution (as in CardGenAlgo)
+static const double MIN_DISTANCE = 1e-9;
+
+// the genomes of the low cards are precomputed, every block of the table combines them with one set of high cards
+static const int LOW_CARDS = 13;
+
+// the first bytes of a table file (the last one was 'S' when the values were floats)
+static const char TABLE_MAGIC[8] = { 'C', 'G', 'A', 'F', 'I', 'T', 'N', 'D' };
+
+struct TableHeader
+{
+	char magic[8];
+	int32_t cards;
+	int32_t sum;
+	int64_t product;
+	uint64_t entries;
+};
+
+// a * b, or INT64_MAX if it does not fit (the factors are positive)
+static inline int64_t multiplySaturated(int64_t a, int64_t b) {
+	return (a > std::numeric_limits<int64_t>::max() / b) ? std::numeric_limits<int64_t>::max() : a * b;
+}
+
+
+FitnessTable::FitnessTable(int sum, int64_t prod, int cards) : mSum(sum), mProduct(prod), mCards(cards) {}
+
+std::shared_ptr<const FitnessTable> FitnessTable::get(int sum, int64_t prod, int cards, const std::string& cacheDir) {
+
+	static std::mutex registryMutex;
+	static std::map<std::tuple<int, int64_t, int>, std::weak_ptr<const FitnessTable> > registry;
+
+	if (cards < 1 || cards > MAX_TABLE_CARDS)
+		throw std::invalid_argument("The fitness table needs at most 26 cards");
+
+	// the other instances with the same target wait for the table instead of building it again
+	std::lock_guard<std::mutex> lock(registryMutex);
+	std::weak_ptr<const FitnessTable>& entry = registry[std::make_tuple(sum, prod, cards)];
+
+	std::shared_ptr<const FitnessTable> table = entry.lock();
+	if (table)
+		return table;
+
+	std::shared_ptr<FitnessTable> built(new FitnessTable(sum, prod, cards));
+	std::string path;
+
+	if (!cacheDir.empty()) {
+		std::ostringstream name;
+		name << cacheDir << "/fitness_" << cards << "_" << sum << "_" << prod << ".tbl";
+		path = name.str();
+	}
+
+	if (path.empty() || !built->load(path)) {
+		built->build();
+		if (!path.empty())
+			built->save(path);
+	}
+
+	entry = built;
+	return built;
+}
+
+void FitnessTable::build() {
+
+	const int lowCards = (mCards < LOW_CARDS) ? mCards : LOW_CARDS;
+	const int highCards = mCards - lowCards;
+	const int lowSize = 1 << lowCards;
+	const int totalSum = mCards * (mCards + 1) / 2;
+
+	vector<int> lowSum(lowSize);
+	vector<int64_t> lowProduct(lowSize);
+
+	// the sum and product of the second stack for every combination of the low cards
+	for (int g = 0; g < lowSize; ++g) {
+		int s = 0;
+		int64_t p = 1;
+		for (int j = 0; j < lowCards; ++j) {
+			if ((g >> j) & 1) {
+				s += j + 1;
+				p = multiplySaturated(p, j + 1);
+			}
+		}
+		lowSum[g] = s;
+		lowProduct[g] = p;
+	}
+
+	mFitness.resize((size_t)1 << mCards);
+
+	// one block for every combination of the high cards
+	auto fillBlock = [&](int high) {
+		int highSum = 0;
+		int64_t highProduct = 1;
+		for (int j = 0; j < highCards; ++j) {
+			if ((high >> j) & 1) {
+				highSum += lowCards + j + 1;
+				highProduct = multiplySaturated(highProduct, lowCards + j + 1);
+			}
+		}
+
+		double* out = &mFitness[(size_t)high << lowCards];
+		for (int low = 0; low < lowSize; ++low) {
+			// the sum is of the first stack, the product of the second (0 if it is empty)
+			int sum = totalSum - highSum - lowSum[low];
+			int64_t product = (high == 0 && low == 0) ? 0 : multiplySaturated(highProduct, lowProduct[low]);
+
+			if (sum == mSum && product == mProduct) {
+				out[low] = 0;
+				continue;
+			}
+
+			double dSum = (double)mSum - sum;
+			double dProduct = (double)mProduct - (double)product;
+			double distance = sqrt(dSum * dSum + dProduct * dProduct);
+
+			if (distance < MIN_DISTANCE)
+				distance = MIN_DISTANCE;
+			out[low] = 1 / distance;
+		}
+	};
+
+	int blocks = 1 << highCards;
+	int threads = (int)std::thread::hardware_concurrency();
+
+	if (blocks > 1 && threads > 1) {
+		ThreadPool pool(threads);
+		pool.run(blocks, fillBlock);
+	} else {
+		for (int high = 0; high < blocks; ++high)
+			fillBlock(high);
+	}
+}
+
+// read the table from a file written by save(), false if it is missing or of another target
+bool FitnessTable::load(const std::string& path) {
+
+	std::ifstream file(path.c_str(), std::ifstream::in | std::ifstream::binary);
+	TableHeader header;
+
+	if (!file.read((char*)&header, sizeof(header)))
+		return false;
+
+	if (memcmp(header.magic, TABLE_MAGIC, sizeof(header.magic)) != 0 || header.cards != mCards || header.sum != mSum ||
+		header.product != mProduct || header.entries != ((uint64_t)1 << mCards))
+		return false;
+
+	mFitness.resize((size_t)header.entries);
+	if (!file.read((char*)&mFitness[0], (std::streamsize)(mFitness.size() * sizeof(double)))) {
+		mFitness.clear();
+		return false;
+	}
+
+	return true;
+}
+
+// write the table next to its final path and move it there, so no reader sees half a file
+// (the cache is optional, so failing to write it is not an error)
+void FitnessTable::save(const std::string& path) const {
+
+	std::string temporary = path + ".tmp";
+	TableHeader header;
+
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, TABLE_MAGIC, sizeof(header.magic));
+	header.cards = mCards;
+	header.sum = mSum;
+	header.product = mProduct;
+	header.entries = mFitness.size();
+
+	{
+		std::ofstream file(temporary.c_str(), std::ofstream::out | std::ofstream::trunc | std::ofstream::binary);
+		file.write((const char*)&header, sizeof(header));
+		file.write((const char*)&mFitness[0], (std::streamsize)(mFitness.size() * sizeof(double)));
+		if (!file) {
+			file.close();
+			std::remove(temporary.c_str());
+			return;
+		}
+	}
+
+	std::remove(path.c_str());
+	std::rename(temporary.c_str(), path.c_str());
+}
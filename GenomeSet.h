@@ -0,0 +1,36 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+
+using std::vector;
+
+class GenomeSet {
+  /*
+   * A multiset of packed genomes (open addressing with linear probing), for the steady-state mode of CardGenAlgo
+   * to tell whether an offspring is already in the population.
+   * The room is reserved up front, so inserting and erasing never allocate.
+   */
+
+private:
+	vector<uint64_t> mKeys;
+	vector<int> mCounts;     // the copies of each key (0 marks an empty slot)
+	size_t mMask;
+	int mShift;
+
+	inline size_t home(uint64_t genes) const { return (size_t)((genes * 0x9E3779B97F4A7C15ULL) >> mShift) & mMask; }
+	size_t find(uint64_t genes) const;
+
+public:
+	GenomeSet() : mMask(0), mShift(63) {}
+
+	// make room for up to capacity genomes and empty the set
+	void reset(int capacity);
+
+	void insert(uint64_t genes);
+	void erase(uint64_t genes);
+	bool contains(uint64_t genes) const { return mCounts[find(genes)] > 0; }
+
+	size_t bytes() const { return mKeys.capacity() * sizeof(uint64_t) + mCounts.capacity() * sizeof(int); }
+};
@@ -0,0 +1,128 @@
+#include "IslandModel.h"
+
+#include <stdexcept>
+#include <thread>
+
+#include "Timing.h"
+
+
+IslandModel::IslandModel(const ExperimentConfig& config, const IslandOptions& islandOptions) :
+	mConfig(config), mIslandOptions(islandOptions), mCurrentGen(0), mWallTimeMs(0)
+{
+	if (mIslandOptions.islands < 1 || mIslandOptions.migrationInterval < 1 || mIslandOptions.migrants < 0)
+		throw std::invalid_argument("There should be at least 1 island, the migration interval should be at least 1 and the migrants positive or 0");
+
+	if (mIslandOptions.islands > 1 && mIslandOptions.migrants >= mConfig.popSize)
+		throw std::invalid_argument("The migrants should be fewer than the population of an island");
+
+	int threads = mIslandOptions.threads;
+	if (threads == 0)
+		threads = (int)std::thread::hardware_concurrency();
+	if (threads < 1 || threads > mIslandOptions.islands)
+		threads = mIslandOptions.islands;
+
+	// a fixed base seed and one fitness table for every island, as in a batch
+	mConfig = BatchRunner::batchConfig(mConfig);
+
+	// every island evolves single threaded with its own random generator
+	for (int i = 0; i < mIslandOptions.islands; ++i) {
+		GAOptions options = mConfig.options;
+		options.threads = 1;
+		options.seed = mConfig.options.seed + (uint64_t)i * 0x9E3779B97F4A7C15ULL;
+		// and its own checkpoint
+		if (!options.checkpointPath.empty())
+			options.checkpointPath += "." + std::to_string(i);
+
+		mIslands.push_back(std::unique_ptr<CardGenAlgo>(new CardGenAlgo(mConfig.sum, mConfig.prod, mConfig.cards, mConfig.popSize,
+			mConfig.pXOver, mConfig.pMutation, mConfig.maxGenerations, OUTPUT_NONE, mConfig.maxGenerations, options)));
+	}
+
+	mEmigrants.resize(mIslandOptions.islands);
+	mSources.resize(mIslandOptions.islands);
+	mPool.reset(new ThreadPool(threads));
+	mRng.seed(mConfig.options.seed ^ 0xD1B54A32D192ED03ULL);
+}
+
+int IslandModel::advanceToFinalGeneration() {
+
+	bool solved = false;
+	int epoch;
+
+	TimeVar now = timeNow();
+
+	while (!solved && mCurrentGen < mConfig.maxGenerations) {
+		epoch = std::min(mIslandOptions.migrationInterval, mConfig.maxGenerations - mCurrentGen);
+
+		// every island runs its own evaluate/select/crossover/mutate cycle
+		mPool->run(mIslandOptions.islands, [&](int i) {
+			mIslands[i]->advanceNGenerations(epoch);
+		});
+		mCurrentGen += epoch;
+
+		for (int i = 0; i < mIslandOptions.islands; ++i)
+			if (mIslands[i]->getResult().solved)
+				solved = true;
+
+		if (!solved && mCurrentGen < mConfig.maxGenerations && mIslandOptions.islands > 1 && mIslandOptions.migrants > 0)
+			migrate();
+	}
+
+	mWallTimeMs += durationMs(timeNow() - now);
+	return mCurrentGen;
+}
+
+void IslandModel::migrate() {
+
+	int islands = mIslandOptions.islands;
+
+	// first every island fills its outgoing buffer
+	for (int i = 0; i < islands; ++i)
+		mIslands[i]->getEmigrants(mIslandOptions.migrants, mEmigrants[i]);
+
+	for (int i = 0; i < islands; ++i) {
+		if (mIslandOptions.topology == TOPOLOGY_RING) {
+			mSources[i] = (i + islands - 1) % islands;
+		} else {
+			// any island but itself
+			mSources[i] = (int)mRng.nextBelow((uint32_t)(islands - 1));
+			if (mSources[i] >= i)
+				mSources[i]++;
+		}
+	}
+
+	// then they all receive from the buffers, which nobody writes to anymore
+	for (int i = 0; i < islands; ++i)
+		mIslands[i]->acceptImmigrants(mEmigrants[mSources[i]]);
+}
+
+RunResult IslandModel::getResult() const {
+
+	RunResult best = RunResult();
+	RunResult island;
+
+	for (int i = 0; i < mIslandOptions.islands; ++i) {
+		island = mIslands[i]->getResult();
+		if (i == 0 || (island.solved && !best.solved) || (island.solved == best.solved && island.best.fitness > best.best.fitness))
+			best = island;
+	}
+
+	best.experiment = 1;
+	best.seed = mConfig.options.seed;
+	if (!best.solved)
+		best.generations = mCurrentGen;
+	best.wallTimeMs = mWallTimeMs;
+
+	return best;
+}
+
+vector<RunResult> IslandModel::getIslandResults() const {
+
+	vector<RunResult> results = vector<RunResult>();
+
+	for (int i = 0; i < mIslandOptions.islands; ++i) {
+		results.push_back(mIslands[i]->getResult());
+		results.back().experiment = i + 1;
+	}
+
+	return results;
+}
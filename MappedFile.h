@@ -0,0 +1,34 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+
+class MappedFile {
+  /*
+   * A file mapped read-only into memory (mmap, or a file mapping on Windows), so large files are read in place
+   * and only the pages that are touched get loaded.
+   */
+
+private:
+	const unsigned char* mData;
+	size_t mLength;
+#ifdef _WIN32
+	void* mFileHandle;
+	void* mMapping;
+#else
+	int mFile;
+#endif
+
+	void close();
+
+public:
+	// throws invalid_argument if the file cannot be opened (an empty file maps to no data)
+	explicit MappedFile(const std::string& path);
+	~MappedFile();
+
+	MappedFile(const MappedFile&) = delete;
+	MappedFile& operator=(const MappedFile&) = delete;
+
+	const unsigned char* data() const { return mData; }
+	size_t size() const { return mLength; }
+};
@@ -0,0 +1,29 @@
+#pragma once
+
+#include <cstdint>
+
+class PerfCounters {
+  /*
+   * Hardware counters (cycles, instructions and cache misses) of the thread that creates them through Linux perf_event.
+   * They only count between start() and stop(). Elsewhere, or when the kernel does not allow it
+   * (see /proc/sys/kernel/perf_event_paranoid), available() is false and every count stays 0.
+   */
+
+private:
+	int mFds[3];             // the group leader counts cycles
+
+	void close();
+
+public:
+	PerfCounters();
+	~PerfCounters();
+
+	PerfCounters(const PerfCounters&) = delete;
+	PerfCounters& operator=(const PerfCounters&) = delete;
+
+	bool available() const { return mFds[0] >= 0; }
+
+	void start();
+	void stop();
+	void read(uint64_t& cycles, uint64_t& instructions, uint64_t& cacheMisses) const;
+};
@@ -0,0 +1,109 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <fstream>
+#include <memory>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+using std::vector;
+
+// the problem a trace belongs to
+struct TraceInfo
+{
+	int cards, sum;
+	int64_t product;
+	int popSize;
+	uint64_t seed;           // the seed of the first experiment
+};
+
+// the report of a generation: the population statistics and the best genotype so far
+struct GenerationRecord
+{
+	int experiment, generation;
+	double totalFitness, avgFitness, stdDev;
+	uint64_t bestGenes;      // packed, bit i is the stack of card i+1
+	int bestSum;
+	int64_t bestProduct;
+	double bestFitness;
+};
+
+class ReportSink {
+  /*
+   * Where the per generation reports of a CardGenAlgo go.
+   * An instance writes through exactly one sink, so a sink does not need to be thread safe
+   * unless it is shared between instances.
+   */
+
+public:
+	virtual ~ReportSink() {}
+
+	// called once before the first record
+	virtual void begin(const TraceInfo& info) = 0;
+	virtual void write(const GenerationRecord& record) = 0;
+	virtual void flush() {}
+	// flush and return the size of the trace file, -1 if the sink has none (a checkpoint keeps it, see truncateTrace())
+	virtual int64_t bytesWritten() { return -1; }
+};
+
+// the size of a file, -1 if it cannot be read
+int64_t fileBytes(const std::string& path);
+// cut a trace file down to its first bytes, so that a resumed run does not repeat what was traced after its checkpoint
+// (a file that is missing or not longer is left as it is)
+void truncateTrace(const std::string& path, int64_t bytes);
+
+class CsvReportSink : public ReportSink {
+  /*
+   * The space separated text trace (output.csv), written through one stream that stays open
+   * and a large buffer, so a record costs no system call.
+   */
+
+private:
+	std::string mPath;
+	std::ofstream mFile;
+	vector<char> mBuffer;
+	int mCards;
+	bool mAppend;            // if the file already has its header
+
+public:
+	// append goes on with the trace in the file (of a resumed run) instead of starting a new one
+	explicit CsvReportSink(const std::string& path, bool append = false);
+	~CsvReportSink();
+
+	void begin(const TraceInfo& info);
+	void write(const GenerationRecord& record);
+	void flush();
+	int64_t bytesWritten();
+};
+
+class AsyncReportSink : public ReportSink {
+  /*
+   * Hands the records to a background thread that passes them on to another sink, so the
+   * generation loop never waits for I/O. Records are collected in one buffer while the writer
+   * thread drains the other.
+   */
+
+private:
+	std::unique_ptr<ReportSink> mSink;
+	vector<GenerationRecord> mPending, mWriting;
+	std::mutex mMutex;
+	std::condition_variable mWake, mDrained;
+	bool mStop;
+	bool mWriterBusy;
+	std::thread mWriter;
+
+	void writerLoop();
+
+public:
+	explicit AsyncReportSink(std::unique_ptr<ReportSink> sink);
+	~AsyncReportSink();
+
+	void begin(const TraceInfo& info);
+	void write(const GenerationRecord& record);
+	// wait until every record so far reached the wrapped sink, and flush it
+	void flush();
+	int64_t bytesWritten();
+};
@@ -0,0 +1,75 @@
+#include "ThreadPool.h"
+
+
+ThreadPool::ThreadPool(int threads) : mTask(nullptr), mTasks(0), mNextTask(0), mBusy(0), mJob(0), mStop(false) {
+	for (int i = 1; i < threads; ++i)
+		mWorkers.push_back(std::thread(&ThreadPool::workerLoop, this));
+}
+
+ThreadPool::~ThreadPool() {
+	{
+		std::lock_guard<std::mutex> lock(mMutex);
+		mStop = true;
+	}
+	mWake.notify_all();
+
+	for (size_t i = 0; i < mWorkers.size(); ++i)
+		mWorkers[i].join();
+}
+
+void ThreadPool::run(int tasks, const std::function<void(int)>& task) {
+
+	if (mWorkers.empty() || tasks <= 1) {
+		for (int i = 0; i < tasks; ++i)
+			task(i);
+		return;
+	}
+
+	{
+		std::lock_guard<std::mutex> lock(mMutex);
+		mTask = &task;
+		mTasks = tasks;
+		mNextTask = 0;
+		mBusy = (int)mWorkers.size();
+		mJob++;
+	}
+	mWake.notify_all();
+
+	// the caller works as well
+	runTasks();
+
+	std::unique_lock<std::mutex> lock(mMutex);
+	mDone.wait(lock, [this] { return mBusy == 0; });
+	mTask = nullptr;
+}
+
+// take tasks of the current job until there are none left
+void ThreadPool::runTasks() {
+	int i;
+
+	while ((i = mNextTask++) < mTasks)
+		(*mTask)(i);
+}
+
+void ThreadPool::workerLoop() {
+
+	unsigned long seenJob = 0;
+
+	while (true) {
+		{
+			std::unique_lock<std::mutex> lock(mMutex);
+			mWake.wait(lock, [this, seenJob] { return mStop || mJob != seenJob; });
+			if (mStop)
+				return;
+			seenJob = mJob;
+		}
+
+		runTasks();
+
+		{
+			std::lock_guard<std::mutex> lock(mMutex);
+			if (--mBusy == 0)
+				mDone.notify_one();
+		}
+	}
+}
@@ -0,0 +1,162 @@
+#include "TraceFile.h"
+
+#include <algorithm>
+#include <stdexcept>
+#include <cstring>
+
+// the records of a block at most (512KB)
+static const size_t TRACE_BUFFER_RECORDS = 1 << 16;
+
+
+BinaryReportSink::BinaryReportSink(const std::string& path, bool append) : mPath(path)
+{
+	mAppend = append && std::ifstream(mPath.c_str(), std::ifstream::binary).peek() != std::ifstream::traits_type::eof();
+	mFile.open(mPath.c_str(), std::ofstream::out | (append ? std::ofstream::app : std::ofstream::trunc) | std::ofstream::binary);
+
+	if (!mFile)
+		throw std::invalid_argument("Could not open " + mPath + " for writing");
+
+	memset(&mBlock, 0, sizeof(mBlock));
+	mBuffer.reserve(TRACE_BUFFER_RECORDS);
+}
+
+BinaryReportSink::~BinaryReportSink() {
+	flush();
+}
+
+void BinaryReportSink::begin(const TraceInfo& info) {
+	TraceHeader header;
+
+	if (mAppend)
+		return;
+	memset(&header, 0, sizeof(header));
+
+	memcpy(header.magic, TRACE_MAGIC, sizeof(header.magic));
+	header.version = TRACE_VERSION;
+	header.recordSize = sizeof(TraceRecord);
+	header.blockSize = sizeof(TraceBlock);
+	header.cards = info.cards;
+	header.sum = info.sum;
+	header.product = info.product;
+	header.popSize = info.popSize;
+	header.seed = info.seed;
+
+	mFile.write((const char*)&header, sizeof(header));
+}
+
+void BinaryReportSink::write(const GenerationRecord& record) {
+	TraceRecord packed;
+	int32_t records = (int32_t)mBuffer.size();
+
+	packed.totalFitness = (float)record.totalFitness;
+	packed.stdDev = (float)record.stdDev;
+
+	// the record goes on with the open block if it only differs from its records in the statistics
+	bool sameBlock = records > 0 && records < (int32_t)TRACE_BUFFER_RECORDS && record.experiment == mBlock.experiment &&
+		record.bestGenes == mBlock.bestGenes && record.bestProduct == mBlock.bestProduct && record.bestSum == mBlock.bestSum &&
+		(float)record.bestFitness == mBlock.bestFitness &&
+		((records == 1) ? record.generation > mBlock.generation : record.generation == mBlock.generation + records * mBlock.step);
+
+	if (!sameBlock) {
+		writeBuffer();
+		mBlock.experiment = record.experiment;
+		mBlock.generation = record.generation;
+		mBlock.step = 0;
+		mBlock.bestGenes = record.bestGenes;
+		mBlock.bestProduct = record.bestProduct;
+		mBlock.bestSum = record.bestSum;
+		mBlock.bestFitness = (float)record.bestFitness;
+	} else if (records == 1) {
+		mBlock.step = record.generation - mBlock.generation;
+	}
+
+	mBuffer.push_back(packed);
+}
+
+void BinaryReportSink::flush() {
+	writeBuffer();
+	mFile.flush();
+}
+
+int64_t BinaryReportSink::bytesWritten() {
+	flush();
+	return fileBytes(mPath);
+}
+
+void BinaryReportSink::writeBuffer() {
+	if (mBuffer.empty())
+		return;
+
+	mBlock.records = (uint32_t)mBuffer.size();
+	mFile.write((const char*)&mBlock, sizeof(mBlock));
+	mFile.write((const char*)&mBuffer[0], (std::streamsize)(mBuffer.size() * sizeof(TraceRecord)));
+	mBuffer.clear();
+}
+
+
+TraceReader::TraceReader(const std::string& path) : mFile(path), mRecords(0)
+{
+	if (mFile.size() < sizeof(TraceHeader))
+		throw std::invalid_argument(path + " is not a trace");
+
+	const TraceHeader& h = header();
+	if (memcmp(h.magic, TRACE_MAGIC, sizeof(h.magic)) != 0)
+		throw std::invalid_argument(path + " is not a trace");
+	if (h.version != TRACE_VERSION || h.recordSize != sizeof(TraceRecord) || h.blockSize != sizeof(TraceBlock))
+		throw std::invalid_argument(path + " is a trace of another version");
+
+	// a trace cut short by a crash keeps its complete records
+	size_t offset = sizeof(TraceHeader);
+	while (offset + sizeof(TraceBlock) <= mFile.size()) {
+		const TraceBlock* block = (const TraceBlock*)(mFile.data() + offset);
+		size_t records = std::min((size_t)block->records, (mFile.size() - offset - sizeof(TraceBlock)) / sizeof(TraceRecord));
+
+		mBlocks.push_back(block);
+		mFirstRecords.push_back(mRecords);
+		mRecords += records;
+		offset += sizeof(TraceBlock) + records * sizeof(TraceRecord);
+
+		if (records < block->records)
+			break;
+	}
+}
+
+TraceInfo TraceReader::info() const {
+	TraceInfo info;
+	const TraceHeader& h = header();
+
+	info.cards = h.cards;
+	info.sum = h.sum;
+	info.product = h.product;
+	info.popSize = h.popSize;
+	info.seed = h.seed;
+
+	return info;
+}
+
+GenerationRecord TraceReader::record(size_t i) const {
+	// the last block that starts at or before the record
+	size_t b = (size_t)(std::upper_bound(mFirstRecords.begin(), mFirstRecords.end(), i) - mFirstRecords.begin()) - 1;
+	const TraceBlock& block = *mBlocks[b];
+	const TraceRecord& packed = records(b)[i - mFirstRecords[b]];
+	GenerationRecord record;
+
+	record.experiment = block.experiment;
+	record.generation = block.generation + (int)(i - mFirstRecords[b]) * block.step;
+	record.totalFitness = packed.totalFitness;
+	record.avgFitness = packed.totalFitness / (double)header().popSize;
+	record.stdDev = packed.stdDev;
+	record.bestGenes = block.bestGenes;
+	record.bestSum = block.bestSum;
+	record.bestProduct = block.bestProduct;
+	record.bestFitness = block.bestFitness;
+
+	return record;
+}
+
+void TraceReader::exportTo(ReportSink& sink) const {
+	sink.begin(info());
+	for (size_t i = 0; i < mRecords; ++i)
+		sink.write(record(i));
+	sink.flush();
+}
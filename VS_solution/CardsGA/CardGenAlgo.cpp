@@ -1,37 +1,118 @@
 #include "CardGenAlgo.h"
+#include "TraceFile.h"
+#include "MappedFile.h"
+#include "Timing.h"
 
 #include <iostream>
-#include <fstream>
 #include <ctime>
 #include <stdexcept>
 #include <cmath>
+#include <algorithm>
+#include <chrono>
+#include <limits>
+#include <fstream>
+#include <cstring>
+#include <cstdio>
 
 using std::cout;
 using std::endl;
 
+// greatest common divisor
+static int gcd(int a, int b) {
+	while (b != 0) {
+		int t = a % b;
+		a = b;
+		b = t;
+	}
+	return a;
+}
+
+// the smallest distance of a genotype that is not a solution
+static const double MIN_DISTANCE = 1e-9;
+
+// adaptRates() moves the probabilities by this factor, within these bounds (the least mutation is a gene per generation,
+// the most about a gene per genotype, past it the search turns random)
+static const double ADAPT_STEP = 1.1;
+static const double MIN_ADAPTED_PXOVER = 0.2, MAX_ADAPTED_PXOVER = 0.95;
+static const double MAX_ADAPTED_PMUTATION = 0.1;
+
+// evaluate() scores the population in blocks of this size and adds up their totals in order, so the totals do not depend
+// on the threads (a population of one block does not bother the worker threads)
+static const int EVAL_BLOCK_SIZE = 4096;
+
+#if CARDSGA_STATS
+// add to a counter of mStats
+#define STATS_ADD(counter, n) (mStats.counter += (uint64_t)(n))
+// run a statement and add its time to a timer of mStats
+#define STATS_TIME(timer, statement) do { \
+		std::chrono::steady_clock::time_point statsStart = std::chrono::steady_clock::now(); \
+		statement; \
+		mStats.timer += (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - statsStart).count(); \
+	} while (0)
+#else
+#define STATS_ADD(counter, n) ((void)0)
+#define STATS_TIME(timer, statement) do { statement; } while (0)
+#endif
+
+// the genes set in a word
+static inline int countGenes(GeneWord genes) {
+#if defined(__GNUC__) || defined(__clang__)
+	return __builtin_popcountll(genes);
+#else
+	int count = 0;
+	for (; genes != 0; genes &= genes - 1)
+		count++;
+	return count;
+#endif
+}
+
+// the bytes a column holds
+template <typename T>
+static size_t columnBytes(const vector<T>& column) {
+	return column.capacity() * sizeof(T);
+}
+
+// replace the contents of column with the entries of the given indices, gathering them into
+// the back buffer (of the same size) and swapping the two
+template <typename T>
+static void gatherColumn(vector<T>& column, vector<T>& back, const vector<int>& indices) {
+	for (size_t i = 0; i < indices.size(); ++i)
+		back[i] = column[indices[i]];
+
+	column.swap(back);
+}
+
+// orders the genotypes so that a heap has the least fit on top (ties go by index, so the top does not depend on the shape of the heap)
+struct FitterFirst
+{
+	const vector<double>& fitness;
+
+	bool operator()(int a, int b) const { return fitness[a] > fitness[b] || (fitness[a] == fitness[b] && a < b); }
+};
+
 
 // Normal Constructor
-CardGenAlgo::CardGenAlgo(int popSize, double pXOver, double pMutation, int maxGenerations, OutputChoice outputChoice, int outputFreq) :
-	mPopsize(popSize), mPXOver(pXOver), mPMutation(pMutation), mMaxGenerations(maxGenerations), mOutputChoice(outputChoice), mTargetSum(36), mTargetProd(360), mTargetCards(10), mOutputFreq(outputFreq)
+CardGenAlgo::CardGenAlgo(int popSize, double pXOver, double pMutation, int maxGenerations, OutputChoice outputChoice, int outputFreq, const GAOptions& options) :
+	mPopsize(popSize), mPXOver(pXOver), mPMutation(pMutation), mStartPXOver(pXOver), mStartPMutation(pMutation), mMaxGenerations(maxGenerations), mOutputChoice(outputChoice), mTargetSum(36), mTargetProd(360), mTargetCards(10), mOutputFreq(outputFreq), mOptions(options)
 {
 	try {
 		mCurrentExp = 1;
+		mTraceBytes = -1;
+		initSeed();
 		checkForInputErrors();
+		initPool();
 		initVars();
 		initialize();
 		
-		if (outputChoice != OUTPUT_CSV)
+		if (outputChoice == OUTPUT_CONSOLE || outputChoice == OUTPUT_BOTH)
 			cout << "> Successfully initialized\n\n";
 
-		if (outputChoice != OUTPUT_CONSOLE) {
-			// append to file
-			std::ofstream outfile("output.csv", std::ofstream::out | std::ofstream::trunc);
-			outfile << "Exp Gen TotFitness AvgFitness StdDev ";
-			for (int i = 0; i < mTargetCards; ++i)
-				outfile << "Card" << i+1 << " ";
-			outfile << "BestGenoSum BestGenoProd BestGenoFitness\n";
-			outfile.close();
-		}
+		// a preempted run goes on from its last checkpoint, and with the trace it had written
+		bool resumed = mOptions.resume && !mOptions.checkpointPath.empty() && std::ifstream(mOptions.checkpointPath.c_str()).good();
+		if (resumed)
+			loadCheckpoint(mOptions.checkpointPath);
+
+		initOutput(resumed);
 	}
 	catch (const std::invalid_argument& e) {
 		cout << e.what();
@@ -40,27 +121,27 @@ CardGenAlgo::CardGenAlgo(int popSize, double pXOver, double pMutation, int maxGe
 }
 
 // Custom Constructor
-CardGenAlgo::CardGenAlgo(int sum, int prod, int totalCards, int popSize, double pXOver, double pMutation, int maxGenerations, OutputChoice outputChoice, int outputFreq) :
-	mPopsize(popSize), mPXOver(pXOver), mPMutation(pMutation), mMaxGenerations(maxGenerations), mOutputChoice(outputChoice), mTargetSum(sum), mTargetProd(prod), mTargetCards(totalCards), mOutputFreq(outputFreq)
+CardGenAlgo::CardGenAlgo(int sum, int64_t prod, int totalCards, int popSize, double pXOver, double pMutation, int maxGenerations, OutputChoice outputChoice, int outputFreq, const GAOptions& options) :
+	mPopsize(popSize), mPXOver(pXOver), mPMutation(pMutation), mStartPXOver(pXOver), mStartPMutation(pMutation), mMaxGenerations(maxGenerations), mOutputChoice(outputChoice), mTargetSum(sum), mTargetProd(prod), mTargetCards(totalCards), mOutputFreq(outputFreq), mOptions(options)
 {
 	try {
 		mCurrentExp = 1;
+		mTraceBytes = -1;
+		initSeed();
 		checkForInputErrors();
+		initPool();
 		initVars();
 		initialize();
 		
-		if (outputChoice != OUTPUT_CSV)
+		if (outputChoice == OUTPUT_CONSOLE || outputChoice == OUTPUT_BOTH)
 			cout << "> Successfully initialized\n\n";
 
-		if (outputChoice != OUTPUT_CONSOLE) {
-			// append to file
-			std::ofstream outfile("output.csv", std::ofstream::out | std::ofstream::trunc);
-			outfile << "Exp Gen TotFitness AvgFitness StdDev ";
-			for (int i = 0; i < mTargetCards; ++i)
-				outfile << "Card" << i+1 << " ";
-			outfile << "BestGenoSum BestGenoProd BestGenoFitness\n";
-			outfile.close();
-		}
+		// a preempted run goes on from its last checkpoint, and with the trace it had written
+		bool resumed = mOptions.resume && !mOptions.checkpointPath.empty() && std::ifstream(mOptions.checkpointPath.c_str()).good();
+		if (resumed)
+			loadCheckpoint(mOptions.checkpointPath);
+
+		initOutput(resumed);
 
 	}
 	catch (const std::invalid_argument& e) {
@@ -76,43 +157,313 @@ void CardGenAlgo::checkForInputErrors() {
 	if ((mPXOver <= 0.0 && mPXOver >= 1.0) || (mPMutation <= 0.0 && mPMutation >= 1.0))
 		throw std::invalid_argument("Probabilities of mutation and crossover should both be in the range (0,1)");
 
+	if (mOptions.tournamentSize<1 || mOptions.truncationRatio <= 0.0 || mOptions.truncationRatio > 1.0)
+		throw std::invalid_argument("Tournament size should be at least 1 and truncation ratio should be in the range (0,1]");
+
+	if (mOptions.elitism<0 || mOptions.elitism >= mPopsize)
+		throw std::invalid_argument("Elitism should be positive or 0 and less than the population size");
+
+	if (mOptions.replacement == REPLACEMENT_STEADY_STATE && (mOptions.replacements<1 || mOptions.replacements >= mPopsize))
+		throw std::invalid_argument("Replacements should be at least 1 and less than the population size");
+
+	if (mOptions.adaptiveRates && (mOptions.diversityLow < 0 || mOptions.diversityLow >= mOptions.diversityHigh))
+		throw std::invalid_argument("The diversity band should be positive and diversityLow less than diversityHigh");
+
+	if (mOptions.stallGenerations < 0 || mOptions.minStdDev < 0 || mOptions.timeBudgetMs < 0)
+		throw std::invalid_argument("The stop criteria should be positive, or 0 for none");
+
+	if (mOptions.threads<0)
+		throw std::invalid_argument("Threads should be positive or 0");
+
+#ifndef __SIZEOF_INT128__
+	if (mOptions.productMode == PRODUCT_INT128)
+		throw std::invalid_argument("128 bit products are not supported by this compiler");
+#endif
+
 	if (mMaxGenerations<1)
 		throw std::invalid_argument("Max Generations should be at least 1");
 
 	if (mTargetSum<0 || mTargetProd<0 || mTargetCards<2)
 		throw std::invalid_argument("Target sum, product should be positive or 0 and cards should be at least 2");
+
+	if (mTargetCards>MAX_CARDS)
+		throw std::invalid_argument("Cards should be at most 64");
+
+	if (mOptions.fitnessTable && (mTargetCards > MAX_TABLE_CARDS || mOptions.productMode != PRODUCT_INT64 || mOptions.productCutoff))
+		throw std::invalid_argument("The fitness table needs PRODUCT_INT64 without cutoff and at most 26 cards");
+
+	if (mOptions.fitnessTable && mOptions.sharedTable && (mOptions.sharedTable->getSum() != mTargetSum ||
+		mOptions.sharedTable->getProduct() != mTargetProd || mOptions.sharedTable->getCards() != mTargetCards))
+		throw std::invalid_argument("The shared fitness table is for another target");
+}
+
+// pick the seed of the random generator
+void CardGenAlgo::initSeed() {
+	mSeed = mOptions.seed;
+
+	if (mSeed == 0)
+		mSeed = (uint64_t)time(NULL) ^ ((uint64_t)std::chrono::high_resolution_clock::now().time_since_epoch().count() << 16);
+}
+
+// start the worker threads (the hardware counters are opened by the thread that advances the generations)
+void CardGenAlgo::initPool() {
+	int threads = mOptions.threads;
+
+	for (int i = 0; i < 3; ++i)
+		mPerfBase[i] = 0;
+
+	if (threads == 0)
+		threads = (int)std::thread::hardware_concurrency();
+
+	if (threads > 1)
+		mPool.reset(new ThreadPool(threads));
+}
+
+// open the trace
+void CardGenAlgo::initOutput(bool append) {
+
+	if (mOutputChoice != OUTPUT_CSV && mOutputChoice != OUTPUT_BOTH)
+		return;
+
+	if (mOptions.reportSink) {
+		mSink = mOptions.reportSink;
+	} else {
+		std::unique_ptr<ReportSink> sink;
+
+		// the generations traced after the checkpoint are run again
+		if (append)
+			truncateTrace(mOptions.outputPath, mTraceBytes);
+
+		switch (mOptions.traceFormat) {
+		case TRACE_BINARY:
+			sink.reset(new BinaryReportSink(mOptions.outputPath, append));
+			break;
+		default:
+			sink.reset(new CsvReportSink(mOptions.outputPath, append));
+			break;
+		}
+
+		if (mOptions.asyncOutput)
+			mSink.reset(new AsyncReportSink(std::move(sink)));
+		else
+			mSink.reset(sink.release());
+	}
+
+	TraceInfo info;
+	info.cards = mTargetCards;
+	info.sum = mTargetSum;
+	info.product = mTargetProd;
+	info.popSize = mPopsize;
+	info.seed = mSeed;
+
+	mSink->begin(info);
 }
 
 void CardGenAlgo::initVars() {
-	bestGenotype = Genotype(mTargetCards);
+	bestGenotype = Genotype();
+	mCardsMask = (mTargetCards == MAX_CARDS) ? ~(GeneWord)0 : (((GeneWord)1 << mTargetCards) - 1);
+
+	// the products of the cards are exact as long as they fit in 64 bits and are not cut off
+	mExactProduct = mOptions.productMode == PRODUCT_INT64 && !mOptions.productCutoff && mTargetCards <= MAX_EXACT_CARDS;
+	// and the kernels saturate them past that, like computeSumProduct() does without a cutoff
+	mKernel = (mOptions.productMode == PRODUCT_INT64 && !mOptions.productCutoff) ? getEvalKernel(mTargetCards, mOptions.vectorize) : nullptr;
+	mProductCutoff = std::numeric_limits<int64_t>::max();
+
+	// with the table nothing but the genes is kept up to date
+	if (mOptions.fitnessTable) {
+		mTable = mOptions.sharedTable ? mOptions.sharedTable : FitnessTable::get(mTargetSum, mTargetProd, mTargetCards, mOptions.fitnessTableCache);
+		mExactProduct = false;
+		mKernel = nullptr;
+	}
+
+	// an empty second stack is -1 in the log domain, to tell it apart from a stack holding just the card 1
+	mLogCard.resize(mTargetCards);
+	for (int j = 0; j < mTargetCards; ++j)
+		mLogCard[j] = log((double)(j + 1));
+
+	if (mOptions.productMode == PRODUCT_LOG)
+		mTargetProdValue = (mTargetProd > 0) ? log((double)mTargetProd) : -1;
+	else
+		mTargetProdValue = (double)mTargetProd;
 	bestGenotypeIndex = 0;
+	mHeap.clear();
 	mCurrentGen = 0;
 	totalFitness = 0;
 	totalFitnessSquare = 0;
 	solutionFound = false;
+	mStopReason = STOP_NONE;
+	mLastImprovement = 0;
+	mEvaluations = 0;
+	mRunTimeMs = 0;
 }
 
 // initialize normal function
 void CardGenAlgo::initialize() {
 
-	mPopulation = vector<Genotype>();
-	mInitialPopulation = vector<Genotype>();
+	size_t bytesBefore = columnBytes();
+
+	mRng.seed(mSeed + mCurrentExp - 1);
+
+	mGenes.assign(mPopsize, 0);
+	mFitness.assign(mPopsize, 0);
+	mSum.assign(mPopsize, 0);
+	mProduct.assign(mPopsize, 0);
+	mCumProb.assign(mPopsize, 0);
+	mAlias.assign(mPopsize, 0);
+	mSurvivors.assign(mPopsize, 0);
+	mRandoms.assign(mPopsize, 0);
+	mBatchIndex.assign(mPopsize, 0);
+	mBatchGenes.assign(mPopsize, 0);
+	mBatchSum.assign(mPopsize, 0);
+	mBatchProduct.assign(mPopsize, 0);
+	mProductValue.assign(mOptions.productMode == PRODUCT_INT64 ? 0 : mPopsize, 0);
+	mRanked.assign(mPopsize, 0);
+	mWillMate.assign(mPopsize, false);
+	mDirty.assign(mPopsize, DIRTY_GENES);
+	mNextGenes.assign(mPopsize, 0);
+	mNextFitness.assign(mPopsize, 0);
+	mNextSum.assign(mPopsize, 0);
+	mNextProduct.assign(mPopsize, 0);
+	mNextProductValue.assign(mProductValue.size(), 0);
+	mNextDirty.assign(mPopsize, DIRTY_GENES);
+	mHeap.reserve(mPopsize);
+	if (mOptions.replacement == REPLACEMENT_STEADY_STATE)
+		mGenomes.reset(mPopsize);
+
+	// generate the random genes, one random word per genotype
+	mPopulationSeed = (mOptions.populationSeed != 0) ? mOptions.populationSeed : mSeed + mCurrentExp - 1;
+	if (mOptions.populationSeed != 0) {
+		RandomGenerator populationRng = RandomGenerator(mOptions.populationSeed);
+		for (int i = 0; i < mPopsize; ++i)
+			mGenes[i] = populationRng.next() & mCardsMask;
+	} else {
+		for (int i = 0; i < mPopsize; ++i)
+			mGenes[i] = mRng.next() & mCardsMask;
+		STATS_ADD(randomDraws, mPopsize);
+	}
 
-	int i, j;
+	mInitialGenes = mGenes;
 
-	srand(time(NULL)+mCurrentExp);
+	// the columns only grow the first time
+	if (columnBytes() > bytesBefore)
+		STATS_ADD(bytesAllocated, columnBytes() - bytesBefore);
+}
+
+// the bytes held by the population columns
+size_t CardGenAlgo::columnBytes() const {
+	return ::columnBytes(mGenes) + ::columnBytes(mInitialGenes) + ::columnBytes(mFitness) + ::columnBytes(mSum) + ::columnBytes(mProduct) +
+		::columnBytes(mProductValue) + ::columnBytes(mCumProb) + ::columnBytes(mAlias) + ::columnBytes(mSurvivors) + ::columnBytes(mRanked) +
+		::columnBytes(mWillMate) + ::columnBytes(mRandoms) + ::columnBytes(mBatchIndex) + ::columnBytes(mBatchSum) + ::columnBytes(mBatchProduct) +
+		::columnBytes(mBatchGenes) + ::columnBytes(mDirty) + ::columnBytes(mNextGenes) + ::columnBytes(mNextFitness) + ::columnBytes(mNextProductValue) +
+		::columnBytes(mNextSum) + ::columnBytes(mNextProduct) + ::columnBytes(mNextDirty) + ::columnBytes(mHeap) + mGenomes.bytes();
+}
 
-	for (i = 0; i < mPopsize; ++i) {
-		Genotype genotype = Genotype(mTargetCards);
+// one generation: evaluate the population and, unless a solution turned up, breed the next one (true if the run ended
+// before maxGenerations, see mStopReason)
+bool CardGenAlgo::runGeneration() {
 
-		// generate the random genes
-		for (j = 0; j < mTargetCards; ++j)
-			genotype.Genes[j] = (int)rand() % 2;
+	bool solved;
+	double bestFitness = bestGenotype.fitness;
+	TimeVar start;
 
-		mPopulation.push_back(genotype);
+	// the clock is only read with a time budget
+	if (mOptions.timeBudgetMs > 0)
+		start = timeNow();
+
+	mCurrentGen++;
+	STATS_ADD(generations, 1);
+
+	STATS_TIME(evaluateNs, solved = (mOptions.replacement == REPLACEMENT_STEADY_STATE) ? evaluateOffspring() : evaluate());
+	if (solved) {
+		solutionFound = true;
+		mStopReason = STOP_SOLVED;
+		STATS_TIME(reportNs, displayDataAndReport(true));
+		checkpointIfDue(true);
+		return true;
 	}
 
-	mInitialPopulation = mPopulation;
+	if (bestGenotype.fitness > bestFitness)
+		mLastImprovement = mCurrentGen;
+
+	if (mOptions.adaptiveRates)
+		adaptRates();
+
+	STATS_TIME(selectNs, select());
+	STATS_TIME(crossoverNs, crossover());
+	STATS_TIME(mutateNs, mutate());
+
+	if (mOptions.timeBudgetMs > 0)
+		mRunTimeMs += durationMs(timeNow() - start);
+
+	// reaching maxGenerations ends the run as it always did, the other criteria end it with a final report
+	mStopReason = checkStop();
+	STATS_TIME(reportNs, displayDataAndReport(mStopReason != STOP_NONE && mStopReason != STOP_MAX_GENERATIONS));
+	checkpointIfDue(mStopReason != STOP_NONE);
+	return mStopReason != STOP_NONE && mStopReason != STOP_MAX_GENERATIONS;
+}
+
+// the criterion of the options that ends the run after this generation, if any (the fitness is the one the population
+// was bred from)
+StopReason CardGenAlgo::checkStop() const {
+
+	if (mOptions.stallGenerations > 0 && mCurrentGen - mLastImprovement >= mOptions.stallGenerations)
+		return STOP_STALLED;
+
+	if (mOptions.minStdDev > 0) {
+		double variance = (totalFitnessSquare - totalFitness * totalFitness / mPopsize) / (mPopsize - 1);
+		if (variance < mOptions.minStdDev * mOptions.minStdDev)
+			return STOP_CONVERGED;
+	}
+
+	if (mOptions.timeBudgetMs > 0 && mRunTimeMs >= mOptions.timeBudgetMs)
+		return STOP_TIME_BUDGET;
+
+	if (mOptions.evaluationBudget > 0 && mEvaluations >= mOptions.evaluationBudget)
+		return STOP_EVALUATION_BUDGET;
+
+	if (mCurrentGen >= mMaxGenerations)
+		return STOP_MAX_GENERATIONS;
+
+	return STOP_NONE;
+}
+
+const char* getStopReasonName(StopReason reason) {
+	switch (reason) {
+	case STOP_SOLVED:
+		return "solved";
+	case STOP_MAX_GENERATIONS:
+		return "max-generations";
+	case STOP_STALLED:
+		return "stalled";
+	case STOP_CONVERGED:
+		return "converged";
+	case STOP_TIME_BUDGET:
+		return "time-budget";
+	case STOP_EVALUATION_BUDGET:
+		return "evaluation-budget";
+	default:
+		return "running";
+	}
+}
+
+// keep the spread of the fitness in the band of the options: when the coefficient of variation falls below it the population
+// has collapsed around a few genotypes and gets more crossover and mutation, above it the population is diverse and gets less
+// (as in Srinivas and Patnaik, where the probabilities rise as the average fitness nears the best, but for the whole population)
+void CardGenAlgo::adaptRates() {
+
+	double avg = totalFitness / mPopsize;
+	double variance = (totalFitnessSquare - totalFitness * avg) / (mPopsize - 1);
+	double diversity = (avg > 0 && variance > 0) ? sqrt(variance) / avg : 0;
+	double minPMutation = 1.0 / ((double)mPopsize * mTargetCards);
+
+	// a bound only stops a step, a rate that starts past it stays there instead of being pulled back against the step
+	if (diversity < mOptions.diversityLow) {
+		mPXOver = std::min(mPXOver * ADAPT_STEP, std::max(mPXOver, MAX_ADAPTED_PXOVER));
+		mPMutation = std::min(mPMutation * ADAPT_STEP, std::max(mPMutation, MAX_ADAPTED_PMUTATION));
+	} else if (diversity > mOptions.diversityHigh) {
+		mPXOver = std::max(mPXOver / ADAPT_STEP, std::min(mPXOver, MIN_ADAPTED_PXOVER));
+		mPMutation = std::max(mPMutation / ADAPT_STEP, std::min(mPMutation, minPMutation));
+	}
 }
 
 int CardGenAlgo::advanceToFinalGeneration() {
@@ -120,28 +471,31 @@ int CardGenAlgo::advanceToFinalGeneration() {
 	bool gotIn = false;
 
 	if (solutionFound) {
-		cout << "> The best genotype has the best fitness possible. There is no need to continue.\n\n";
+		if (mOutputChoice != OUTPUT_NONE)
+			cout << "> The best genotype has the best fitness possible. There is no need to continue.\n\n";
 		return mCurrentGen;
 	}
 
+	if (mStopReason != STOP_NONE && mStopReason != STOP_MAX_GENERATIONS) {
+		if (mOutputChoice != OUTPUT_NONE)
+			cout << "> The run was stopped early (" << getStopReasonName(mStopReason) << "). Try restarting!\n\n";
+		return mCurrentGen;
+	}
+
+	startCounters();
+
 	for (int i = mCurrentGen; i < mMaxGenerations; ++i) {
 		gotIn = true;
-		mCurrentGen++;
-		if (!evaluate()) {
-			select();
-			crossover();
-			mutate();
-		}
-		else {
-			solutionFound = true;
-			displayDataAndReport(true);
-			return mCurrentGen;
-		}
-		displayDataAndReport(false);
+		if (runGeneration())
+			break;
 	}
 
+	if (mPerf)
+		mPerf->stop();
+
 	if (!gotIn) {
-		cout << "You are already at the last generation. Try restarting!\n" << endl;
+		if (mOutputChoice != OUTPUT_NONE)
+			cout << "You are already at the last generation. Try restarting!\n" << endl;
 		return mCurrentGen;
 	}
 
@@ -151,12 +505,20 @@ int CardGenAlgo::advanceToFinalGeneration() {
 int CardGenAlgo::advanceNGenerations(int n) {
 	
 	if (n < 1) {
-		cout << "You need to advance one or more generations.." << endl;
+		if (mOutputChoice != OUTPUT_NONE)
+			cout << "You need to advance one or more generations.." << endl;
 		return mCurrentGen;
 	}
 
 	if (solutionFound) {
-		cout << "> The best genotype has the best fitness possible. There is no need to continue.\n\n";
+		if (mOutputChoice != OUTPUT_NONE)
+			cout << "> The best genotype has the best fitness possible. There is no need to continue.\n\n";
+		return mCurrentGen;
+	}
+
+	if (mStopReason != STOP_NONE && mStopReason != STOP_MAX_GENERATIONS) {
+		if (mOutputChoice != OUTPUT_NONE)
+			cout << "> The run was stopped early (" << getStopReasonName(mStopReason) << "). Try restarting!\n\n";
 		return mCurrentGen;
 	}
 
@@ -166,40 +528,343 @@ int CardGenAlgo::advanceNGenerations(int n) {
 	if (targetGen >= mMaxGenerations)
 		targetGen = mMaxGenerations;
 
+	startCounters();
+
 	for (int i = mCurrentGen; i < targetGen; ++i) {
 		gotIn = true;
-		mCurrentGen++;
-		if (!evaluate()) {
-			select();
-			crossover();
-			mutate();
-		}
-		else {
-			solutionFound = true;
-			displayDataAndReport(true);
+		if (runGeneration())
 			break;
-		}
-		displayDataAndReport(false);
 	}
 
-	if (!gotIn) cout << "You are already at the last generation. Try restarting!\n" << endl;
+	if (mPerf)
+		mPerf->stop();
+
+	if (!gotIn && mOutputChoice != OUTPUT_NONE)
+		cout << "You are already at the last generation. Try restarting!\n" << endl;
 	return mCurrentGen;
 }
 
 void CardGenAlgo::restartSimulation(bool samePopulation) {
 
 	mCurrentExp++;
+	mPXOver = mStartPXOver;
+	mPMutation = mStartPMutation;
 	initVars();
 
 	if (samePopulation) {
-		mPopulation = mInitialPopulation;
-		cout << "> Reinitialized with the initial population.\n\n" << endl;
+		// the experiment gets its own random generator, the population keeps its seed
+		mRng.seed(mSeed + mCurrentExp - 1);
+		mGenes = mInitialGenes;
+		mDirty.assign(mPopsize, DIRTY_GENES);
+		if (mOutputChoice != OUTPUT_NONE)
+			cout << "> Reinitialized with the initial population.\n\n" << endl;
 	} else {
 		initialize();
-		cout << "> Reinitialized with different population.\n\n" << endl;
+		if (mOutputChoice != OUTPUT_NONE)
+			cout << "> Reinitialized with different population.\n\n" << endl;
 	}
 }
 
+// copy the genes of the (at most) count fittest genotypes whose evaluation is up to date, topped up with the best genotype
+void CardGenAlgo::getEmigrants(int count, vector<GeneWord>& genes) const {
+
+	vector<int> candidates = vector<int>();
+	int top;
+
+	genes.clear();
+	if (count < 1)
+		return;
+
+	for (int i = 0; i < mPopsize; ++i)
+		if (mDirty[i] == DIRTY_NONE)
+			candidates.push_back(i);
+
+	top = std::min(count, (int)candidates.size());
+	std::partial_sort(candidates.begin(), candidates.begin() + top, candidates.end(), [this](int a, int b) { return mFitness[a] > mFitness[b]; });
+
+	genes.push_back(bestGenotype.Genes);
+	for (int i = 0; i < top && (int)genes.size() < count; ++i)
+		if (mGenes[candidates[i]] != bestGenotype.Genes)
+			genes.push_back(mGenes[candidates[i]]);
+}
+
+// replace the least fit genotypes with the given genes (they are evaluated in the next generation)
+void CardGenAlgo::acceptImmigrants(const vector<GeneWord>& genes) {
+
+	int count = std::min((int)genes.size(), mPopsize);
+	if (count < 1)
+		return;
+
+	for (int i = 0; i < mPopsize; ++i)
+		mRanked[i] = i;
+	std::nth_element(mRanked.begin(), mRanked.begin() + (count - 1), mRanked.end(), [this](int a, int b) { return mFitness[a] < mFitness[b]; });
+
+	for (int i = 0; i < count; ++i) {
+		mGenes[mRanked[i]] = genes[i] & mCardsMask;
+		mDirty[mRanked[i]] = DIRTY_GENES;
+	}
+
+	// the next step scores the whole population again
+	mHeap.clear();
+}
+
+GAStats CardGenAlgo::getStats() const {
+	GAStats stats = mStats;
+
+	if (mPerf && mPerf->available()) {
+		stats.hardwareCounters = true;
+		mPerf->read(stats.cycles, stats.instructions, stats.cacheMisses);
+		stats.cycles += mPerfBase[0];
+		stats.instructions += mPerfBase[1];
+		stats.cacheMisses += mPerfBase[2];
+	}
+
+	return stats;
+}
+
+// perf_event counts the thread that opens the counters, so they are opened by the first thread that advances the
+// generations, and opened again (keeping the counts so far) when another thread takes over
+void CardGenAlgo::startCounters() {
+
+	if (!mOptions.hardwareCounters)
+		return;
+
+	if (mPerf && mPerfThread != std::this_thread::get_id()) {
+		uint64_t counts[3];
+		mPerf->read(counts[0], counts[1], counts[2]);
+		for (int i = 0; i < 3; ++i)
+			mPerfBase[i] += counts[i];
+		mPerf.reset();
+	}
+
+	if (!mPerf) {
+		mPerf.reset(new PerfCounters());
+		mPerfThread = std::this_thread::get_id();
+	}
+
+	mPerf->start();
+}
+
+// start counting from 0 (the hardware counters keep running totals)
+void CardGenAlgo::resetStats() {
+	mStats = GAStats();
+}
+
+// the start of a checkpoint file, followed by the columns of the population: the genes, the initial genes, the fitness,
+// the products, the product values (if productValues), the sums and the dirty states
+static const char CHECKPOINT_MAGIC[8] = { 'C', 'G', 'A', 'C', 'H', 'K', 'P', 'T' };
+static const uint32_t CHECKPOINT_VERSION = 5;
+
+struct CheckpointHeader
+{
+	char magic[8];
+	uint32_t version;
+	int32_t popSize, cards, sum;
+	int64_t product;
+	int32_t maxGenerations, productMode, selection, mutation, tournamentSize;
+	int32_t currentGen, currentExp, bestIndex;
+	double pXOver, pMutation, truncationRatio;
+	double startPXOver, startPMutation;
+	uint64_t seed, populationSeed;
+	uint64_t rngState[4];
+	uint64_t bestGenes;
+	double bestFitness;
+	int64_t bestProduct;
+	int32_t bestSum, solutionFound;
+	double totalFitness, totalFitnessSquare;
+	int64_t productCutoff;
+	int32_t productValues, reserved;
+	int32_t stopReason, lastImprovement;
+	uint64_t evaluations;
+	double runTimeMs;
+	int32_t replacement, elitism;
+	int32_t replacements, adaptiveRates;
+	double diversityLow, diversityHigh;
+	int64_t traceBytes;      // the size of the trace file at the checkpoint (-1 for none)
+};
+
+static_assert(sizeof(CheckpointHeader) == 280, "the checkpoint header must not be padded");
+
+template <typename T>
+static void writeColumn(std::ofstream& file, const vector<T>& column) {
+	file.write((const char*)column.data(), column.size() * sizeof(T));
+}
+
+template <typename T>
+static const unsigned char* readColumn(const unsigned char* data, vector<T>& column) {
+	memcpy(column.data(), data, column.size() * sizeof(T));
+	return data + column.size() * sizeof(T);
+}
+
+void CardGenAlgo::saveCheckpoint(const std::string& path) const {
+
+	CheckpointHeader h;
+	memset(&h, 0, sizeof(h));
+	memcpy(h.magic, CHECKPOINT_MAGIC, sizeof(h.magic));
+	h.version = CHECKPOINT_VERSION;
+	h.popSize = mPopsize;
+	h.cards = mTargetCards;
+	h.sum = mTargetSum;
+	h.product = mTargetProd;
+	h.maxGenerations = mMaxGenerations;
+	h.productMode = mOptions.productMode;
+	h.selection = mOptions.selection;
+	h.mutation = mOptions.mutation;
+	h.tournamentSize = mOptions.tournamentSize;
+	h.currentGen = mCurrentGen;
+	h.currentExp = mCurrentExp;
+	h.bestIndex = bestGenotypeIndex;
+	h.pXOver = mPXOver;
+	h.pMutation = mPMutation;
+	h.truncationRatio = mOptions.truncationRatio;
+	h.startPXOver = mStartPXOver;
+	h.startPMutation = mStartPMutation;
+	h.seed = mSeed;
+	h.populationSeed = mPopulationSeed;
+	mRng.getState(h.rngState);
+	h.bestGenes = bestGenotype.Genes;
+	h.bestFitness = bestGenotype.fitness;
+	h.bestProduct = bestGenotype.product;
+	h.bestSum = bestGenotype.sum;
+	h.solutionFound = solutionFound;
+	h.totalFitness = totalFitness;
+	h.totalFitnessSquare = totalFitnessSquare;
+	h.productCutoff = mProductCutoff;
+	h.productValues = !mProductValue.empty();
+	h.stopReason = mStopReason;
+	h.lastImprovement = mLastImprovement;
+	h.evaluations = mEvaluations;
+	h.runTimeMs = mRunTimeMs;
+	h.replacement = mOptions.replacement;
+	h.elitism = mOptions.elitism;
+	h.replacements = mOptions.replacements;
+	h.adaptiveRates = mOptions.adaptiveRates;
+	h.diversityLow = mOptions.diversityLow;
+	h.diversityHigh = mOptions.diversityHigh;
+	h.traceBytes = mSink ? mSink->bytesWritten() : -1;
+
+	// written next to the old one and renamed over it, so a crash leaves one of the two intact
+	std::string temporary = path + ".tmp";
+	{
+		std::ofstream file(temporary.c_str(), std::ofstream::binary | std::ofstream::trunc);
+		if (!file)
+			throw std::invalid_argument("Could not open " + temporary + " for writing");
+
+		file.write((const char*)&h, sizeof(h));
+		writeColumn(file, mGenes);
+		writeColumn(file, mInitialGenes);
+		writeColumn(file, mFitness);
+		writeColumn(file, mProduct);
+		writeColumn(file, mProductValue);
+		writeColumn(file, mSum);
+		writeColumn(file, mDirty);
+
+		if (!file.flush())
+			throw std::invalid_argument("Could not write " + temporary);
+	}
+
+	std::remove(path.c_str());
+	if (std::rename(temporary.c_str(), path.c_str()) != 0)
+		throw std::invalid_argument("Could not rename " + temporary + " to " + path);
+}
+
+void CardGenAlgo::loadCheckpoint(const std::string& path) {
+
+	MappedFile file(path);
+	CheckpointHeader h;
+	size_t columns;
+
+	if (file.size() < sizeof(h) || memcmp(file.data(), CHECKPOINT_MAGIC, sizeof(h.magic)) != 0)
+		throw std::invalid_argument(path + " is not a checkpoint");
+	memcpy(&h, file.data(), sizeof(h));
+
+	if (h.version != CHECKPOINT_VERSION)
+		throw std::invalid_argument(path + " is a checkpoint of another version");
+
+	if (h.popSize != mPopsize || h.cards != mTargetCards || h.sum != mTargetSum || h.product != mTargetProd || h.productMode != mOptions.productMode)
+		throw std::invalid_argument(path + " is a checkpoint of another problem, population size or product mode");
+
+	// the columns in the order saveCheckpoint() writes them
+	columns = (size_t)mPopsize * (2 * sizeof(GeneWord) + sizeof(double) + sizeof(int64_t) + (h.productValues ? sizeof(double) : 0) + sizeof(int) + sizeof(char));
+	if (file.size() != sizeof(h) + columns || (h.productValues != 0) != !mProductValue.empty())
+		throw std::invalid_argument(path + " is truncated or corrupt");
+
+	// the parameters of the run that was saved
+	mMaxGenerations = h.maxGenerations;
+	mPXOver = h.pXOver;
+	mPMutation = h.pMutation;
+	mOptions.selection = (SelectionMethod)h.selection;
+	mOptions.mutation = (MutationMethod)h.mutation;
+	mOptions.tournamentSize = h.tournamentSize;
+	mOptions.truncationRatio = h.truncationRatio;
+	mOptions.replacement = (ReplacementMode)h.replacement;
+	mOptions.elitism = h.elitism;
+	mOptions.replacements = h.replacements;
+	mOptions.adaptiveRates = h.adaptiveRates != 0;
+	mOptions.diversityLow = h.diversityLow;
+	mOptions.diversityHigh = h.diversityHigh;
+	mStartPXOver = h.startPXOver;
+	mStartPMutation = h.startPMutation;
+	checkForInputErrors();
+
+	const unsigned char* data = file.data() + sizeof(h);
+	data = readColumn(data, mGenes);
+	data = readColumn(data, mInitialGenes);
+	data = readColumn(data, mFitness);
+	data = readColumn(data, mProduct);
+	data = readColumn(data, mProductValue);
+	data = readColumn(data, mSum);
+	readColumn(data, mDirty);
+
+	mCurrentGen = h.currentGen;
+	mCurrentExp = h.currentExp;
+	mSeed = h.seed;
+	mPopulationSeed = h.populationSeed;
+	mRng.setState(h.rngState);
+	bestGenotypeIndex = h.bestIndex;
+	bestGenotype.Genes = h.bestGenes;
+	bestGenotype.fitness = h.bestFitness;
+	bestGenotype.product = h.bestProduct;
+	bestGenotype.sum = h.bestSum;
+	solutionFound = h.solutionFound != 0;
+	totalFitness = h.totalFitness;
+	totalFitnessSquare = h.totalFitnessSquare;
+	mProductCutoff = h.productCutoff;
+	mStopReason = (StopReason)h.stopReason;
+	mLastImprovement = h.lastImprovement;
+	mEvaluations = h.evaluations;
+	mRunTimeMs = h.runTimeMs;
+	mTraceBytes = h.traceBytes;
+	mHeap.clear();
+}
+
+// save a checkpoint every checkpointInterval generations and when the run ends
+void CardGenAlgo::checkpointIfDue(bool ended) {
+
+	if (mOptions.checkpointPath.empty())
+		return;
+
+	if (ended || mCurrentGen >= mMaxGenerations || (mOptions.checkpointInterval > 0 && mCurrentGen % mOptions.checkpointInterval == 0))
+		saveCheckpoint(mOptions.checkpointPath);
+}
+
+RunResult CardGenAlgo::getResult() const {
+	RunResult result = RunResult();
+
+	result.experiment = mCurrentExp;
+	result.seed = mSeed + mCurrentExp - 1;
+	result.populationSeed = mPopulationSeed;
+	result.generations = mCurrentGen;
+	result.solved = solutionFound;
+	result.best = bestGenotype;
+	result.pXOver = mPXOver;
+	result.pMutation = mPMutation;
+	result.stopReason = mStopReason;
+	result.evaluations = mEvaluations;
+
+	return result;
+}
+
 void CardGenAlgo::reportGeneration() {
 
 	double avg, stddev, square_sum;
@@ -208,184 +873,535 @@ void CardGenAlgo::reportGeneration() {
 	square_sum = totalFitness*totalFitness / (double)mPopsize;
 	stddev = sqrt((1.0 / (double)(mPopsize - 1))*(totalFitnessSquare - square_sum));
 
-	cout << "> GEN: " << mCurrentGen << endl;
-	cout << "- Total fitness: " << totalFitness << endl;
-	cout << "- Avg Fitness: " << avg << endl;
-	cout << "- Standard Deviation: " << stddev << endl;
-	cout << "- Best Genotype: " << endl << "-- ";
-	for (int j = 0; j < mTargetCards; j++)
-		cout << bestGenotype.Genes[j] << " ";
-	cout << endl << "-- Sum: " << bestGenotype.sum << endl;
-	cout << "-- Product: " << bestGenotype.product << endl;
-	cout << "-- Fitness: " << bestGenotype.fitness << endl << endl;
+	printGeneration("> GEN: ", avg, stddev);
+	cout << "\n";
 }
 
 void CardGenAlgo::displayDataAndReport(bool ended) {
 
 	double avg, stddev, square_sum;
 
+	if (!ended && mCurrentGen%mOutputFreq != 0)
+		return;
+
 	avg = totalFitness / (double) mPopsize;
 	square_sum = totalFitness*totalFitness / (double) mPopsize;
 	stddev = sqrt((1.0 / (double)(mPopsize - 1))*(totalFitnessSquare - square_sum));
 
-	if (ended) {
-		if (mOutputChoice == OUTPUT_BOTH || mOutputChoice == OUTPUT_CONSOLE) {
-			cout << "------------------------------------" << endl;
-			cout << "> FINAL GEN: " << mCurrentGen << endl;
-			cout << "- Total fitness: " << totalFitness << endl;
-			cout << "- Avg Fitness: " << avg << endl;
-			cout << "- Standard Deviation: " << stddev << endl;
-			cout << "- Best Genotype: " << endl << "-- ";
-			for (int j = 0; j < mTargetCards; j++)
-				cout << bestGenotype.Genes[j] << " ";
-			cout << endl << "-- Sum: " << bestGenotype.sum << endl;
-			cout << "-- Product: " << bestGenotype.product << endl;
-			cout << "-- Fitness: " << bestGenotype.fitness << endl;
-			cout << "------------------------------------" << endl << endl;
-		}
-
-		// append to file
-		if (mOutputChoice == OUTPUT_BOTH || mOutputChoice == OUTPUT_CSV) {
-			std::ofstream outfile("output.csv", std::ios_base::app);
-			outfile << mCurrentExp << " " << mCurrentGen << " " << totalFitness << " " << avg << " " << stddev << " ";
-			for (int i = 0; i < mTargetCards; ++i) {
-				outfile << bestGenotype.Genes[i] << " ";
-			}
-			outfile << bestGenotype.sum << " " << bestGenotype.product << " " << bestGenotype.fitness << endl;
-			outfile.close();
+	// output to console
+	if (mOutputChoice == OUTPUT_BOTH || mOutputChoice == OUTPUT_CONSOLE) {
+		if (ended) {
+			cout << "------------------------------------\n";
+			printGeneration("> FINAL GEN: ", avg, stddev);
+			cout << "------------------------------------\n\n";
+		} else {
+			printGeneration("> GEN: ", avg, stddev);
+			cout << "\n";
 		}
 	}
-	else {
-		if (mCurrentGen%mOutputFreq == 0) {
-			// output to console
-			if (mOutputChoice == OUTPUT_BOTH || mOutputChoice == OUTPUT_CONSOLE) {
-			
-				cout << "> GEN: " << mCurrentGen << endl;
-				cout << "- Total fitness: " << totalFitness << endl;
-				cout << "- Avg Fitness: " << avg << endl;
-				cout << "- Standard Deviation: " << stddev << endl;
-				cout << "- Best Genotype: " << endl << "-- ";
-				for (int j = 0; j < mTargetCards; j++)
-					cout << bestGenotype.Genes[j] << " ";
-				cout << endl << "-- Sum: " << bestGenotype.sum << endl;
-				cout << "-- Product: " << bestGenotype.product << endl;
-				cout << "-- Fitness: " << bestGenotype.fitness << endl << endl;
-			}
 
-			// append to file
-			if (mOutputChoice == OUTPUT_BOTH || mOutputChoice == OUTPUT_CSV) {
-				std::ofstream outfile("output.csv", std::ios_base::app);
-				outfile << mCurrentExp << " " << mCurrentGen << " " << totalFitness << " " << avg << " " << stddev << " "; 
-				for (int i = 0; i < mTargetCards; ++i) {
-					outfile << bestGenotype.Genes[i] << " ";
-				}
-				outfile << bestGenotype.sum << " " << bestGenotype.product << " " << bestGenotype.fitness << endl;
-				outfile.close();
-			}
-		}
+	// append to file
+	if (mSink) {
+		GenerationRecord record;
+		record.experiment = mCurrentExp;
+		record.generation = mCurrentGen;
+		record.totalFitness = totalFitness;
+		record.avgFitness = avg;
+		record.stdDev = stddev;
+		record.bestGenes = bestGenotype.Genes;
+		record.bestSum = bestGenotype.sum;
+		record.bestProduct = bestGenotype.product;
+		record.bestFitness = bestGenotype.fitness;
+
+		mSink->write(record);
+
+		// the trace of a finished run is complete on disk
+		if (ended)
+			mSink->flush();
 	}
 }
 
+void CardGenAlgo::printGeneration(const char* title, double avg, double stddev) {
+	cout << title << mCurrentGen << "\n";
+	cout << "- Total fitness: " << totalFitness << "\n";
+	cout << "- Avg Fitness: " << avg << "\n";
+	cout << "- Standard Deviation: " << stddev << "\n";
+	cout << "- Best Genotype: " << "\n" << "-- ";
+	for (int j = 0; j < mTargetCards; j++)
+		cout << bestGenotype.getGene(j) << " ";
+	cout << "\n" << "-- Sum: " << bestGenotype.sum << "\n";
+	cout << "-- Product: " << bestGenotype.product << "\n";
+	cout << "-- Fitness: " << bestGenotype.fitness << "\n";
+}
+
 
-// evaluate the fitness of each genome
+// evaluate the fitness of each genome (only the genotypes that changed since the last evaluation are rescored)
 bool CardGenAlgo::evaluate() {
 	if (mPopsize > 0) {
 
-		int sum, product;
-		bool thereIsCardInProduct = false;
+		vector<EvalPartial>& partials = mPartials;
+		int blocks = (mPopsize + EVAL_BLOCK_SIZE - 1) / EVAL_BLOCK_SIZE;
 
-		totalFitness = 0;
-		totalFitnessSquare = 0;
+		// a product this far above the target cannot beat the best genotype
+		if (mOptions.productCutoff && mOptions.productMode != PRODUCT_LOG && bestGenotype.fitness > 0) {
+			double cutoff = ceil((double)mTargetProd + 1 / bestGenotype.fitness);
+			if (cutoff < (double)std::numeric_limits<int64_t>::max())
+				mProductCutoff = (int64_t)cutoff;
+		}
 
-		// for every genotype
-		for (int i = 0; i < mPopsize; ++i) {
-			sum = 0;
-			product = 1;
-			thereIsCardInProduct = false;
-
-			// for every gene
-			for (int j = 0; j < mTargetCards; ++j) {
-				if (mPopulation[i].Genes[j] == 0)    // if the card in the first stack we add
-					sum += j + 1;
-				else {								 // if it is in the second one we multiply
-					thereIsCardInProduct = true;
-					product *= j + 1;
-				}
-			}
+		partials.resize(blocks);
 
-			if (!thereIsCardInProduct) product = 0;
+		if (!mPool || blocks == 1) {
+			for (int b = 0; b < blocks; ++b) {
+				evaluateRange(b * EVAL_BLOCK_SIZE, std::min(mPopsize, (b + 1) * EVAL_BLOCK_SIZE), partials[b], nullptr);
+				if (partials[b].solutionIndex >= 0)
+					break;
+			}
+		} else {
+			// once a solution is found the blocks after it stop early, the ones before it go on in case they hold an earlier
+			// one, so the solution is the one a single thread finds
+			std::atomic<int> firstSolution(blocks);
+
+			// the task captures just two pointers, small enough for std::function to hold without allocating
+			mPool->run(blocks, [this, &firstSolution](int b) {
+				evaluateRange(b * EVAL_BLOCK_SIZE, std::min(mPopsize, (b + 1) * EVAL_BLOCK_SIZE), mPartials[b], &firstSolution);
+				if (mPartials[b].solutionIndex >= 0) {
+					int first = firstSolution.load();
+					while (b < first && !firstSolution.compare_exchange_weak(first, b)) {}
+				}
+			});
+		}
 
-			mPopulation[i].sum = sum;
-			mPopulation[i].product = product;
+		// merge the partial results in order (up to the first solution, the blocks after it may not have run)
+		totalFitness = 0;
+		totalFitnessSquare = 0;
 
-			mPopulation[i].fitness = getEuclideanDistance(sum, product);
+		for (int c = 0; c < blocks; ++c) {
+			STATS_ADD(evaluations, partials[c].evaluations);
+			mEvaluations += partials[c].evaluations;
 
-			if (mPopulation[i].fitness == 0) {
-				setBestGenotype(i);
+			if (partials[c].solutionIndex >= 0) {
+				setBestGenotype(partials[c].solutionIndex);
 				bestGenotype.fitness = 1;
 				return true;
 			}
-			mPopulation[i].fitness = 1 / (mPopulation[i].fitness);
 
-			
 			// update totalFitness and totalFitnessSquare
-			totalFitness += mPopulation[i].fitness;
-			totalFitnessSquare += pow(mPopulation[i].fitness, 2);
+			totalFitness += partials[c].totalFitness;
+			totalFitnessSquare += partials[c].totalFitnessSquare;
 
 			// we save the best genotype
-			if (mPopulation[i].fitness > bestGenotype.fitness)
-				setBestGenotype(i);
+			if (partials[c].bestIndex >= 0 && partials[c].bestFitness > bestGenotype.fitness)
+				setBestGenotype(partials[c].bestIndex);
+		}
+	}
+	return false;
+}
+
+// compute the sums and products of the genotypes packed in [from,from+batch) of the batch columns, through the
+// kernel when there is one, and store them in the population
+void CardGenAlgo::computeBatch(int from, int batch) {
+
+	if (batch == 0)
+		return;
+
+	if (mKernel) {
+		mKernel(&mBatchGenes[from], batch, mTargetCards, &mBatchSum[from], &mBatchProduct[from]);
+	} else {
+		double productValue;
+
+		for (int k = from; k < from + batch; ++k) {
+			computeSumProduct(mBatchGenes[k], mBatchSum[k], mBatchProduct[k], productValue);
+			if (!mProductValue.empty())
+				mProductValue[mBatchIndex[k]] = productValue;
+		}
+	}
+
+	for (int k = from; k < from + batch; ++k) {
+		mSum[mBatchIndex[k]] = mBatchSum[k];
+		mProduct[mBatchIndex[k]] = mBatchProduct[k];
+	}
+}
+
+// evaluate the genotypes in [from,to), stopping at the first perfect one or when a block before this one has one
+void CardGenAlgo::evaluateRange(int from, int to, EvalPartial& partial, const std::atomic<int>* firstSolution) {
+
+	int batch = 0;
+
+	partial.totalFitness = 0;
+	partial.totalFitnessSquare = 0;
+	partial.bestIndex = -1;
+	partial.bestFitness = bestGenotype.fitness;
+	partial.solutionIndex = -1;
+	partial.evaluations = 0;
+
+	// first the genotypes whose genes changed are packed together (in the [from,to) part of the batch columns,
+	// so the ranges of different threads do not overlap) and their sum and product computed in one go (the table needs neither)
+	for (int i = from; i < to; ++i) {
+		if (mDirty[i] == DIRTY_GENES && !mTable) {
+			mBatchIndex[from + batch] = i;
+			mBatchGenes[from + batch] = mGenes[i];
+			batch++;
+		}
+	}
+
+	computeBatch(from, batch);
+
+	// then the fitness of every genotype
+	for (int i = from; i < to; ++i) {
+
+		if (firstSolution && (i & 255) == 0 && firstSolution->load(std::memory_order_relaxed) < from / EVAL_BLOCK_SIZE)
+			return;
+
+		if (mDirty[i] != DIRTY_NONE) {
+			mDirty[i] = DIRTY_NONE;
+			partial.evaluations++;
+
+			mFitness[i] = scoreGenotype(i);
+			if (mFitness[i] == 0) {
+				partial.solutionIndex = i;
+				return;
+			}
+		}
+
+		partial.totalFitness += mFitness[i];
+		partial.totalFitnessSquare += mFitness[i] * mFitness[i];
+
+		if (mFitness[i] > partial.bestFitness) {
+			partial.bestFitness = mFitness[i];
+			partial.bestIndex = i;
 		}
 	}
+}
+
+// score the offspring of the last step and put them back in the heap (REPLACEMENT_STEADY_STATE), the first time
+// the whole population is scored and the heap built (true if a solution was found)
+bool CardGenAlgo::evaluateOffspring() {
+
+	FitterFirst order = { mFitness };
+	double fitness;
+	int index, batch = 0;
+
+	if (mHeap.empty()) {
+		if (evaluate())
+			return true;
+
+		mGenomes.reset(mPopsize);
+		for (int i = 0; i < mPopsize; ++i) {
+			mHeap.push_back(i);
+			mGenomes.insert(mGenes[i]);
+		}
+		std::make_heap(mHeap.begin(), mHeap.end(), order);
+		return false;
+	}
+
+	// the offspring whose genes changed get their sums and products in one go, as in evaluateRange()
+	for (int c = 0; c < mOptions.replacements; ++c) {
+		index = mRanked[c];
+		if (mDirty[index] == DIRTY_GENES && !mTable) {
+			mBatchIndex[batch] = index;
+			mBatchGenes[batch] = mGenes[index];
+			batch++;
+		}
+	}
+	computeBatch(0, batch);
+
+	for (int c = 0; c < mOptions.replacements; ++c) {
+		index = mRanked[c];
+
+		if (mDirty[index] != DIRTY_NONE) {
+			fitness = scoreGenotype(index);
+			mDirty[index] = DIRTY_NONE;
+			STATS_ADD(evaluations, 1);
+			mEvaluations++;
+
+			if (fitness == 0) {
+				mFitness[index] = 0;
+				setBestGenotype(index);
+				bestGenotype.fitness = 1;
+				return true;
+			}
+
+			totalFitness += fitness - mFitness[index];
+			totalFitnessSquare += fitness * fitness - mFitness[index] * mFitness[index];
+			mFitness[index] = fitness;
+		}
+
+		if (mFitness[index] > bestGenotype.fitness)
+			setBestGenotype(index);
+
+		mHeap.push_back(index);
+		std::push_heap(mHeap.begin(), mHeap.end(), order);
+	}
+
 	return false;
 }
 
-// calculate the probabilities of each genotype and select those that will pass to the next gen
+// select the genotypes that will pass to the next gen
 void CardGenAlgo::select() {
 
-	vector<Genotype> newPopulation = vector<Genotype>();
-	double roulette;
-	int j;
+	if (mOptions.replacement == REPLACEMENT_STEADY_STATE) {
+		selectSteadyState();
+		return;
+	}
 
-	// first we set the selection/cumulative probabilities for every genotype
-	for (int i = 0; i < mPopsize; ++i) {
-		mPopulation[i].pSel = mPopulation[i].fitness / totalFitness;
+	switch (mOptions.selection) {
+	case SELECTION_TOURNAMENT:
+		selectTournament();
+		break;
+	case SELECTION_SUS:
+		selectStochasticUniversal();
+		break;
+	case SELECTION_RANK:
+		selectRank();
+		break;
+	case SELECTION_TRUNCATION:
+		selectTruncation();
+		break;
+	default:
+		selectRoulette();
+	}
 
-		if (i!=0) {
-			mPopulation[i].pCum = mPopulation[i - 1].pCum + mPopulation[i].pSel;
-		} else {
-			mPopulation[i].pCum = mPopulation[i].pSel;
+	// the elites take the first places (crossover and mutation leave them alone)
+	if (mOptions.elitism > 0) {
+		for (int i = 0; i < mPopsize; ++i)
+			mRanked[i] = i;
+		std::nth_element(mRanked.begin(), mRanked.begin() + (mOptions.elitism - 1), mRanked.end(), [this](int a, int b) { return mFitness[a] > mFitness[b]; });
+
+		for (int i = 0; i < mOptions.elitism; ++i)
+			mSurvivors[i] = mRanked[i];
+	}
+
+	// finally we set the new population (the survivors keep their cached evaluation)
+	gatherColumn(mGenes, mNextGenes, mSurvivors);
+	gatherColumn(mSum, mNextSum, mSurvivors);
+	gatherColumn(mProduct, mNextProduct, mSurvivors);
+	if (!mProductValue.empty())
+		gatherColumn(mProductValue, mNextProductValue, mSurvivors);
+	gatherColumn(mFitness, mNextFitness, mSurvivors);
+	gatherColumn(mDirty, mNextDirty, mSurvivors);
+}
+
+// calculate the probabilities of each genotype and spin the roulette once for every survivor
+void CardGenAlgo::selectRoulette() {
+
+	double cum = 0;
+
+	// first we set the cumulative probabilities for every genotype
+	if (mOptions.selection == SELECTION_ROULETTE_ALIAS) {
+		buildAliasTable();
+	} else {
+		for (int i = 0; i < mPopsize; ++i) {
+			cum += mFitness[i] / totalFitness;
+			mCumProb[i] = cum;
 		}
 	}
 
 	// then we select based on the cumulative probability
+	mRng.fillDoubles(&mRandoms[0], mPopsize);
+	STATS_ADD(randomDraws, mPopsize);
+	for (int i = 0; i < mPopsize; ++i)
+		mSurvivors[i] = drawSurvivor(mRandoms[i]);
+}
+
+// every survivor is the fittest of tournamentSize uniformly drawn genotypes (no normalisation needed)
+void CardGenAlgo::selectTournament() {
+
+	int winner, challenger;
+
 	for (int i = 0; i < mPopsize; ++i) {
-		roulette = randZeroToOne();
+		winner = randIndex(mPopsize);
 
-		if (mPopulation[0].pCum > roulette) {
-			newPopulation.push_back(mPopulation[0]);
-			continue;
+		for (int k = 1; k < mOptions.tournamentSize; ++k) {
+			challenger = randIndex(mPopsize);
+			if (mFitness[challenger] > mFitness[winner])
+				winner = challenger;
 		}
 
-		if (mPopulation[mPopsize - 1].pCum < roulette) {
-			newPopulation.push_back(mPopulation[bestGenotypeIndex]);
-			continue;
+		mSurvivors[i] = winner;
+	}
+}
+
+// one spin of a roulette with mPopsize equally spaced pointers
+void CardGenAlgo::selectStochasticUniversal() {
+
+	double step = totalFitness / mPopsize;
+	double pointer = randZeroToOne() * step;
+	double cum = mFitness[0];
+	int j = 0;
+
+	// the copies of a genotype are spread over the population with a stride coprime to its size,
+	// otherwise they would sit next to each other and mate among themselves in crossover()
+	int stride = (int)(mPopsize * 0.618) | 1;
+	while (gcd(stride, mPopsize) != 1) stride += 2;
+	long long slot = 0;
+
+	for (int i = 0; i < mPopsize; ++i) {
+		while (cum < pointer && j < mPopsize - 1)
+			cum += mFitness[++j];
+
+		mSurvivors[(int)slot] = j;
+		slot = (slot + stride) % mPopsize;
+		pointer += step;
+	}
+}
+
+// roulette over the ranks: the ith least fit genotype has a weight of i
+void CardGenAlgo::selectRank() {
+
+	double total = (double)mPopsize * (mPopsize + 1) / 2;
+	double x;
+	int rank;
+
+	for (int i = 0; i < mPopsize; ++i)
+		mRanked[i] = i;
+	std::sort(mRanked.begin(), mRanked.end(), [this](int a, int b) { return mFitness[a] < mFitness[b]; });
+
+	for (int i = 0; i < mPopsize; ++i) {
+		// the smallest rank whose cumulative weight rank*(rank+1)/2 reaches x
+		x = randZeroToOne() * total;
+		rank = (int)ceil((sqrt(8 * x + 1) - 1) / 2);
+		if (rank < 1) rank = 1;
+		if (rank > mPopsize) rank = mPopsize;
+
+		mSurvivors[i] = mRanked[rank - 1];
+	}
+}
+
+// only the fittest truncationRatio of the population may survive, each with the same probability
+void CardGenAlgo::selectTruncation() {
+
+	int top = (int)(mPopsize * mOptions.truncationRatio);
+	if (top < 1) top = 1;
+
+	for (int i = 0; i < mPopsize; ++i)
+		mRanked[i] = i;
+	std::nth_element(mRanked.begin(), mRanked.begin() + (top - 1), mRanked.end(), [this](int a, int b) { return mFitness[a] > mFitness[b]; });
+
+	for (int i = 0; i < mPopsize; ++i)
+		mSurvivors[i] = mRanked[randIndex(top)];
+}
+
+// the parents of the offspring of a step are tournament winners, their copies (genes and evaluation) take the places
+// of the least fit genotypes, which leave the heap until the offspring are scored (REPLACEMENT_STEADY_STATE)
+void CardGenAlgo::selectSteadyState() {
+
+	FitterFirst order = { mFitness };
+	int children = mOptions.replacements;
+	int parent, challenger, slot;
+
+	// the parents go to the back buffers first, as a parent may be one of the genotypes that are replaced
+	for (int c = 0; c < children; ++c) {
+		parent = randIndex(mPopsize);
+		for (int k = 1; k < mOptions.tournamentSize; ++k) {
+			challenger = randIndex(mPopsize);
+			if (mFitness[challenger] > mFitness[parent])
+				parent = challenger;
 		}
 
+		mNextGenes[c] = mGenes[parent];
+		mNextSum[c] = mSum[parent];
+		mNextProduct[c] = mProduct[parent];
+		if (!mProductValue.empty())
+			mNextProductValue[c] = mProductValue[parent];
+		mNextFitness[c] = mFitness[parent];
+		mNextDirty[c] = mDirty[parent];
+	}
+
+	for (int c = 0; c < children; ++c) {
+		std::pop_heap(mHeap.begin(), mHeap.end(), order);
+		slot = mHeap.back();
+		mHeap.pop_back();
+		mGenomes.erase(mGenes[slot]);
+
+		// the totals follow the fitness column
+		totalFitness += mNextFitness[c] - mFitness[slot];
+		totalFitnessSquare += mNextFitness[c] * mNextFitness[c] - mFitness[slot] * mFitness[slot];
+
+		mGenes[slot] = mNextGenes[c];
+		mSum[slot] = mNextSum[c];
+		mProduct[slot] = mNextProduct[c];
+		if (!mProductValue.empty())
+			mProductValue[slot] = mNextProductValue[c];
+		mFitness[slot] = mNextFitness[c];
+		mDirty[slot] = mNextDirty[c];
+
+		mRanked[c] = slot;
+	}
+}
+
+// spin the roulette once and return the index of the survivor
+int CardGenAlgo::drawSurvivor(double roulette) {
+
+	int j;
+
+	switch (mOptions.selection) {
+	case SELECTION_ROULETTE_ALIAS:
+		// pick a column uniformly and then either it or its alias
+		roulette *= mPopsize;
+		j = (int)roulette;
+		if (j >= mPopsize) j = mPopsize - 1;
+		return (roulette - j < mCumProb[j]) ? j : mAlias[j];
+
+	case SELECTION_ROULETTE_BINARY:
+		// the survivor is the first genotype whose cumulative probability reaches the roulette
+		j = (int)(std::lower_bound(mCumProb.begin(), mCumProb.end(), roulette) - mCumProb.begin());
+		return (j < mPopsize) ? j : bestGenotypeIndex;
+
+	default:
+		if (mCumProb[0] > roulette)
+			return 0;
+
+		if (mCumProb[mPopsize - 1] < roulette)
+			return bestGenotypeIndex;
+
 		j = 0;
 		do {
-			if (mPopulation[j].pCum < roulette && mPopulation[j + 1].pCum >= roulette) {
+			if (mCumProb[j] < roulette && mCumProb[j + 1] >= roulette) {
 				// we found a survivor
-				newPopulation.push_back(mPopulation[j + 1]);
-				break;
+				return j + 1;
 			}
 			j++;
 		} while (j < mPopsize-1 );
+
+		return 0;
 	}
+}
 
-	// finally we set the new population
-	mPopulation = newPopulation;
-	
+// build Vose's alias table over the fitness of the population, storing the probabilities in mCumProb
+void CardGenAlgo::buildAliasTable() {
+
+	// the genotypes whose scaled probability is below/above the average (stored in mSurvivors, which is free until the draws)
+	int small = 0, large = mPopsize;
+	int s, l;
+
+	for (int i = 0; i < mPopsize; ++i) {
+		mCumProb[i] = mFitness[i] * mPopsize / totalFitness;
+		if (mCumProb[i] < 1.0)
+			mSurvivors[small++] = i;
+		else
+			mSurvivors[--large] = i;
+	}
+
+	// every small column is topped up by a large one
+	while (small > 0 && large < mPopsize) {
+		s = mSurvivors[--small];
+		l = mSurvivors[large];
+
+		mAlias[s] = l;
+		mCumProb[l] -= 1.0 - mCumProb[s];
+
+		if (mCumProb[l] < 1.0) {
+			large++;
+			mSurvivors[small++] = l;
+		}
+	}
+
+	// whatever is left is full because of rounding errors
+	while (small > 0)
+		mCumProb[mSurvivors[--small]] = 1.0;
+	while (large < mPopsize)
+		mCumProb[mSurvivors[large++]] = 1.0;
 }
 
 // perform mating of genotypes
@@ -393,103 +1409,397 @@ void CardGenAlgo::crossover() {
 
 	int lovers = 0;
 	int newLoverIndex, candidate = 0, firstLover = 0, secondLover = 0;
+	int elites = mOptions.elitism, others = mPopsize - elites;
+
+	if (mOptions.replacement == REPLACEMENT_STEADY_STATE) {
+		// the offspring mate in pairs
+		for (int c = 0; c + 1 < mOptions.replacements; c += 2) {
+			if (randZeroToOne() < mPXOver) {
+				mateGenotypes(mRanked[c], mRanked[c + 1], randIndex(mTargetCards - 1) + 1);
+				STATS_ADD(crossovers, 1);
+			}
+		}
+		return;
+	}
 
 	// first we find based on our probability which genotypes will mate
+	mRng.fillDoubles(&mRandoms[0], mPopsize);
+	STATS_ADD(randomDraws, mPopsize);
 	for (int i = 0; i < mPopsize; ++i) {
-		if (randZeroToOne() < mPXOver) {
-			mPopulation[i].willMate = true;
-			lovers++;
-		}
+		mWillMate[i] = i >= elites && mRandoms[i] < mPXOver;
+		lovers += mWillMate[i];
 	}
 
 	// then we make sure we have an even amount of lovers
 	if ((lovers % 2) != 0) {
-		do {
-			newLoverIndex = (int)rand() % mPopsize;
-		} while (mPopulation[newLoverIndex].willMate);
+		if (lovers == others) {
+			// everybody mates already, so one of them sits out instead
+			mWillMate[elites + randIndex(others)] = false;
+			lovers--;
+		} else {
+			do {
+				newLoverIndex = elites + randIndex(others);
+			} while (mWillMate[newLoverIndex]);
 
-		mPopulation[newLoverIndex].willMate = true;
-		lovers++;
+			mWillMate[newLoverIndex] = true;
+			lovers++;
+		}
 	}
 
 	// perform mating
 	for (int i = 0; i<(lovers / 2); ++i) {
 
 		// first lover
-		while (!mPopulation[candidate].willMate) candidate++;
+		while (!mWillMate[candidate]) candidate++;
 		firstLover = candidate;
 		candidate++;
 		
 		// second lover
-		while (!mPopulation[candidate].willMate) candidate++;
+		while (!mWillMate[candidate]) candidate++;
 		secondLover = candidate;
 		candidate++;
 
 		// they will not mate again in this generation
-		mPopulation[firstLover].willMate = false;
-		mPopulation[secondLover].willMate = false;
+		mWillMate[firstLover] = false;
+		mWillMate[secondLover] = false;
 
 		// crossover point
-		int xoverPoint = ((int)rand() % 9) + 1;
+		int xoverPoint = randIndex(mTargetCards - 1) + 1;
 
 		mateGenotypes(firstLover, secondLover, xoverPoint);
 	}
+
+	STATS_ADD(crossovers, lovers / 2);
 }
 
 
 // perform mutation based on the probability of mutation
 void CardGenAlgo::mutate() {
+
+	// only the offspring of the last step, and one that is already in the population gets more genes flipped
+	// (a few times at most), as copies crowd the population out around a local optimum
+	if (mOptions.replacement == REPLACEMENT_STEADY_STATE) {
+		for (int c = 0; c < mOptions.replacements; ++c) {
+			int index = mRanked[c];
+
+			if (mPMutation > 0.0)
+				mutateGenotype(index);
+
+			for (int tries = 0; tries < mTargetCards && mGenomes.contains(mGenes[index]); ++tries) {
+				flipGene(index, randIndex(mTargetCards));
+				STATS_ADD(mutations, 1);
+			}
+			mGenomes.insert(mGenes[index]);
+		}
+		return;
+	}
+
+	if (mPMutation <= 0.0)
+		return;
+
+	switch (mOptions.mutation) {
+	case MUTATION_PER_GENE:
+		mutatePerGene();
+		break;
+	case MUTATION_WORD_MASK:
+		mutateWordMask();
+		break;
+	default:
+		mutateGeometric();
+	}
+}
+
+// one random draw for every gene
+void CardGenAlgo::mutatePerGene() {
 	int i, j;
 
-	for (i = 0; i < mPopsize; ++i) {
+	for (i = mOptions.elitism; i < mPopsize; ++i) {
 		for (j = 0; j < mTargetCards; ++j) {
 			if (randZeroToOne() < mPMutation) {
 				// this gene will be mutated
+				flipGene(i, j);
+				STATS_ADD(mutations, 1);
+			}
+		}
+	}
+}
+
+// walk the genes of the whole population jumping straight from one mutated gene to the next
+void CardGenAlgo::mutateGeometric() {
 
-				int gene = mPopulation[i].Genes[j];
-				if (gene == 0)
-					mPopulation[i].Genes[j] = 1;
-				else
-					mPopulation[i].Genes[j] = 0;
+	int elites = mOptions.elitism;
+	long long totalGenes = (long long)(mPopsize - elites) * mTargetCards;
+	long long position = -1;
+	double logNoMutation = log1p(-mPMutation);
+	double skip;
+
+	if (mPMutation >= 1.0) {
+		for (int i = elites; i < mPopsize; ++i)
+			flipGenes(i, mCardsMask);
+		STATS_ADD(mutations, totalGenes);
+		return;
+	}
+
+	while (true) {
+		// the number of genes that are left alone before the next mutation is geometrically distributed
+		skip = floor(log(1.0 - randZeroToOne()) / logNoMutation);
+		if (skip >= (double)(totalGenes - position))
+			break;
+
+		position += (long long)skip + 1;
+		if (position >= totalGenes)
+			break;
+
+		flipGene(elites + (int)(position / mTargetCards), (int)(position % mTargetCards));
+		STATS_ADD(mutations, 1);
+	}
+}
+
+// every gene survives k random words ANDed together with probability 2^-k
+void CardGenAlgo::mutateWordMask() {
+
+	int k = (int)floor(-log2(mPMutation) + 0.5);
+	GeneWord mask;
+
+	if (k < 1) k = 1;
+
+	for (int i = mOptions.elitism; i < mPopsize; ++i) {
+		mask = mCardsMask;
+		for (int w = 0; w < k && mask != 0; ++w)
+			mask &= randWord();
+
+		if (mask != 0) {
+			flipGenes(i, mask);
+			STATS_ADD(mutations, countGenes(mask));
+		}
+	}
+}
+
+
+// mutate a single genotype with the mutation method of the population (REPLACEMENT_STEADY_STATE)
+void CardGenAlgo::mutateGenotype(int index) {
+
+	GeneWord mask;
+	int k, position = -1;
+	double logNoMutation, skip;
+
+	if (mPMutation >= 1.0) {
+		flipGenes(index, mCardsMask);
+		STATS_ADD(mutations, mTargetCards);
+		return;
+	}
+
+	switch (mOptions.mutation) {
+	case MUTATION_PER_GENE:
+		for (int j = 0; j < mTargetCards; ++j) {
+			if (randZeroToOne() < mPMutation) {
+				flipGene(index, j);
+				STATS_ADD(mutations, 1);
 			}
 		}
+		break;
+
+	case MUTATION_WORD_MASK:
+		k = (int)floor(-log2(mPMutation) + 0.5);
+		if (k < 1) k = 1;
+
+		mask = mCardsMask;
+		for (int w = 0; w < k && mask != 0; ++w)
+			mask &= randWord();
+
+		if (mask != 0) {
+			flipGenes(index, mask);
+			STATS_ADD(mutations, countGenes(mask));
+		}
+		break;
+
+	default:
+		logNoMutation = log1p(-mPMutation);
+		while (true) {
+			skip = floor(log(1.0 - randZeroToOne()) / logNoMutation);
+			if (skip >= (double)(mTargetCards - position))
+				break;
+
+			position += (int)skip + 1;
+			if (position >= mTargetCards)
+				break;
+
+			flipGene(index, position);
+			STATS_ADD(mutations, 1);
+		}
 	}
 }
 
 
 // generate a random double in [0,1)
-inline double CardGenAlgo::randZeroToOne() { return rand() / (RAND_MAX + 1.); }
+inline double CardGenAlgo::randZeroToOne() { STATS_ADD(randomDraws, 1); return mRng.nextDouble(); }
+
+// generate a random 64 bit word
+inline GeneWord CardGenAlgo::randWord() { STATS_ADD(randomDraws, 1); return mRng.next(); }
+
+// generate a random integer in [0,n)
+inline int CardGenAlgo::randIndex(int n) { STATS_ADD(randomDraws, 1); return (int)mRng.nextBelow((uint32_t)n); }
+
+// the sum and product of a genome, saturating (or stopping at mProductCutoff) instead of overflowing
+void CardGenAlgo::computeSumProduct(GeneWord genes, int& sum, int64_t& product, double& productValue) {
 
-inline double CardGenAlgo::getEuclideanDistance(int sum, int product) {
-	double distance = 0;
+	const int64_t maxProduct = std::numeric_limits<int64_t>::max();
+	int64_t p = 1;
+	int s = 0, card;
+	GeneWord rest;
 
-	distance += pow(mTargetSum - sum, 2);
-	distance += pow(mTargetProd - product, 2);
-	distance = pow(distance, 0.5);
+	for (int j = 0; j < mTargetCards; ++j)
+		s += (1 - (int)((genes >> j) & 1)) * (j + 1);
+
+	for (rest = genes, card = 1; rest != 0; rest >>= 1, ++card) {
+		if ((rest & 1) == 0)
+			continue;
+
+		if (p > mProductCutoff / card) {
+			// past the cutoff (or the end of the 64 bits), p stays a lower bound of the real product
+			p = (p > maxProduct / card) ? maxProduct : p * card;
+			break;
+		}
+		p *= card;
+	}
 
-	return distance;
+	sum = s;
+	product = (genes == 0) ? 0 : p;
+
+	switch (mOptions.productMode) {
+	case PRODUCT_LOG:
+		productValue = (genes == 0) ? -1 : 0;
+		for (int j = 0; j < mTargetCards; ++j)
+			if ((genes >> j) & 1)
+				productValue += mLogCard[j];
+		break;
+
+	case PRODUCT_INT128:
+#ifdef __SIZEOF_INT128__
+		{
+			const unsigned __int128 maxWide = ~(unsigned __int128)0 >> 1;
+			unsigned __int128 limit = (mProductCutoff == maxProduct) ? maxWide : (unsigned __int128)mProductCutoff;
+			unsigned __int128 wide = 1;
+
+			for (rest = genes, card = 1; rest != 0; rest >>= 1, ++card) {
+				if ((rest & 1) == 0)
+					continue;
+
+				if (wide > limit / card) {
+					wide = (wide > maxWide / card) ? maxWide : wide * card;
+					break;
+				}
+				wide *= card;
+			}
+
+			productValue = (genes == 0) ? 0 : (double)wide;
+		}
+#endif
+		break;
+
+	default:
+		productValue = (double)product;
+	}
+}
+
+inline double CardGenAlgo::getEuclideanDistance(int sum, double product) {
+	double dSum = (double)mTargetSum - sum;
+	double dProduct = mTargetProdValue - product;
+
+	return sqrt(dSum * dSum + dProduct * dProduct);
+}
+
+// the fitness of a genotype whose sum and product are up to date (any genotype with the table), 0 for a solution
+inline double CardGenAlgo::scoreGenotype(int i) {
+
+	double distance;
+
+	// a perfect genome has a fitness of 0 in the table
+	if (mTable)
+		return mTable->fitness(mGenes[i]);
+
+	if (mSum[i] == mTargetSum && mProduct[i] == mTargetProd)
+		return 0;
+
+	distance = getEuclideanDistance(mSum[i], mOptions.productMode == PRODUCT_INT64 ? (double)mProduct[i] : mProductValue[i]);
+
+	// rounding can make a wide product look equal to the target
+	if (distance < MIN_DISTANCE)
+		distance = MIN_DISTANCE;
+	return 1 / distance;
 }
 
 void CardGenAlgo::setBestGenotype(int index) {
-	bestGenotype.Genes = mPopulation[index].Genes;
-	bestGenotype.fitness = mPopulation[index].fitness;
-	bestGenotype.pSel = mPopulation[index].pSel;
-	bestGenotype.pCum = mPopulation[index].pCum;
-	bestGenotype.willMate = mPopulation[index].willMate;
-	bestGenotype.sum = mPopulation[index].sum;
-	bestGenotype.product = mPopulation[index].product;
+	bestGenotype.Genes = mGenes[index];
+	bestGenotype.fitness = mFitness[index];
+	bestGenotype.sum = mSum[index];
+	bestGenotype.product = mProduct[index];
+
+	// the table keeps no sums and products, so the best genotype gets its own
+	if (mTable) {
+		double productValue;
+		computeSumProduct(bestGenotype.Genes, bestGenotype.sum, bestGenotype.product, productValue);
+	}
 
 	bestGenotypeIndex = index;
 }
 
 void CardGenAlgo::mateGenotypes(int first, int second, int xPoint) {
-	
-	Genotype temp = mPopulation[first];
 
-	for (int i = xPoint; i < mTargetCards; ++i)
-		temp.Genes[i] = mPopulation[second].Genes[i];
-	for (int i = xPoint; i < mTargetCards; ++i)
-		mPopulation[second].Genes[i] = mPopulation[first].Genes[i];
+	// the genes from the crossover point onwards are swapped
+	GeneWord tailMask = mCardsMask & ~(((GeneWord)1 << xPoint) - 1);
+	GeneWord diff = (mGenes[first] ^ mGenes[second]) & tailMask;
+
+	if (diff != 0) {
+		mGenes[first] ^= diff;
+		mGenes[second] ^= diff;
+		mDirty[first] = DIRTY_GENES;
+		mDirty[second] = DIRTY_GENES;
+	}
+}
+
+// flip the genes of a genotype under mask
+void CardGenAlgo::flipGenes(int index, GeneWord mask) {
+
+	if (mDirty[index] == DIRTY_GENES || !mExactProduct) {
+		mGenes[index] ^= mask;
+		mDirty[index] = DIRTY_GENES;
+		return;
+	}
+
+	for (int j = 0; mask != 0; ++j, mask >>= 1)
+		if (mask & 1)
+			flipGene(index, j);
+}
+
+// flip a gene of a genotype, updating its sum and product by the value of the moved card
+void CardGenAlgo::flipGene(int index, int gene) {
+
+	GeneWord bit = (GeneWord)1 << gene;
+	GeneWord genes = mGenes[index];
+	int card = gene + 1;
+
+	mGenes[index] = genes ^ bit;
+
+	if (mDirty[index] == DIRTY_GENES)
+		return;
+
+	if (!mExactProduct) {
+		// the cached product may have overflown so it cannot be divided back
+		mDirty[index] = DIRTY_GENES;
+		return;
+	}
+
+	if ((genes & bit) == 0) {
+		// the card moves from the first stack to the second
+		mSum[index] -= card;
+		mProduct[index] = (genes == 0) ? card : mProduct[index] * card;
+	}
+	else {
+		// the card moves from the second stack to the first
+		mSum[index] += card;
+		mProduct[index] = ((genes ^ bit) == 0) ? 0 : mProduct[index] / card;
+	}
 
-	mPopulation[first] = temp;
+	mDirty[index] = DIRTY_FITNESS;
 }
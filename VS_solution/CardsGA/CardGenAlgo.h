@@ -1,23 +1,181 @@
 #pragma once
 
 #include <vector>
+#include <cstdint>
+#include <memory>
+#include <atomic>
+#include <string>
+#include <thread>
+
+#include "RandomGenerator.h"
+#include "ThreadPool.h"
+#include "EvalKernel.h"
+#include "ReportSink.h"
+#include "FitnessTable.h"
+#include "PerfCounters.h"
+#include "GenomeSet.h"
 
 using std::vector;
 
-enum OutputChoice { OUTPUT_CONSOLE, OUTPUT_CSV, OUTPUT_BOTH };
+// the timers and counters of getStats(), build with CARDSGA_STATS=0 to compile them out
+#ifndef CARDSGA_STATS
+#define CARDSGA_STATS 1
+#endif
+
+enum OutputChoice { OUTPUT_CONSOLE, OUTPUT_CSV, OUTPUT_BOTH, OUTPUT_NONE };
+
+// how the survivors of each generation are picked
+enum SelectionMethod {
+	SELECTION_ROULETTE_LINEAR,   // roulette wheel, linear scan of the cumulative probabilities, O(N) per draw
+	SELECTION_ROULETTE_BINARY,   // roulette wheel, binary search of the cumulative probabilities, O(log N) per draw
+	SELECTION_ROULETTE_ALIAS,    // roulette wheel, Vose's alias table, O(1) per draw
+	SELECTION_TOURNAMENT,        // the fittest of tournamentSize random genotypes survives
+	SELECTION_SUS,               // stochastic universal sampling, one random draw per generation
+	SELECTION_RANK,              // roulette wheel over the fitness ranks instead of the fitness values
+	SELECTION_TRUNCATION         // survivors are drawn uniformly from the fittest truncationRatio of the population
+};
+
+// how the genes to be mutated are picked
+enum MutationMethod {
+	MUTATION_PER_GENE,     // one random draw for every gene of every genotype
+	MUTATION_GEOMETRIC,    // draw the gap to the next mutated gene from a geometric distribution, one draw per mutation
+	MUTATION_WORD_MASK     // XOR a random mask into each genome, the probability is rounded to a power of 1/2 (for high mutation rates)
+};
+
+// how the product of the second stack is computed and compared with the target
+enum ProductMode {
+	PRODUCT_INT64,     // 64 bit product, saturating at INT64_MAX
+	PRODUCT_INT128,    // 128 bit product (where the compiler has it), the distance uses the exact value up to 2^127
+	PRODUCT_LOG        // the distance compares the logarithms of the product and the target, for wide card ranges
+};
+
+// how the offspring replace the population
+enum ReplacementMode {
+	REPLACEMENT_GENERATIONAL,   // the survivors of the selection (and the elites) make up the whole next generation
+	REPLACEMENT_STEADY_STATE    // at every step a few offspring of tournament winners replace the least fit genotypes
+	                            // (an offspring that copies a genotype of the population gets more genes flipped, up to a
+	                            // flip per card, so copies are avoided on a best-effort basis but can still get in)
+};
+
+// why a run ended
+enum StopReason {
+	STOP_NONE,               // it has not
+	STOP_SOLVED,             // a perfect genotype was found
+	STOP_MAX_GENERATIONS,    // it ran maxGenerations
+	STOP_STALLED,            // the best fitness did not improve for GAOptions::stallGenerations
+	STOP_CONVERGED,          // the standard deviation of the fitness fell below GAOptions::minStdDev
+	STOP_TIME_BUDGET,        // it took GAOptions::timeBudgetMs
+	STOP_EVALUATION_BUDGET   // it scored GAOptions::evaluationBudget genotypes
+};
+
+// the name of a stop reason in the reports ("solved", "stalled"...)
+const char* getStopReasonName(StopReason reason);
+
+// the format of the trace written with OUTPUT_CSV/OUTPUT_BOTH
+enum TraceFormat {
+	TRACE_TEXT,      // space separated text, one line per report
+	TRACE_BINARY     // blocks of binary records (see TraceFile.h), read back with TraceReader
+};
+
+// optional settings of the algorithm, passed to the constructors
+struct GAOptions
+{
+	uint64_t seed;               // the seed of the random generator of the instance (0 picks one from the clock)
+	uint64_t populationSeed;     // if not 0, the initial population is drawn from its own generator with this seed
+	int threads;                 // the threads that evaluate the population (0 uses every core)
+	bool vectorize;              // if the sums and products are computed with the SIMD kernel the CPU supports, instead of the table kernel
+	                             // (off by default, the two tie over a whole run)
+	SelectionMethod selection;   // the selection method
+	int tournamentSize;          // the genotypes competing in each tournament (SELECTION_TOURNAMENT)
+	double truncationRatio;      // the part of the population that may survive (SELECTION_TRUNCATION)
+	ReplacementMode replacement; // the replacement mode
+	int elitism;                 // the fittest genotypes that pass on to the next generation unchanged (REPLACEMENT_GENERATIONAL)
+	int replacements;            // the least fit genotypes replaced at every step (REPLACEMENT_STEADY_STATE)
+	MutationMethod mutation;     // the mutation method
+	bool adaptiveRates;          // move pXOver and pMutation every generation to keep the spread of the fitness in a band (see adaptRates())
+	double diversityLow, diversityHigh;   // the band, of the coefficient of variation (stddev / average) of the fitness
+	                                      // (measured: a random population is around 4, one stuck around a local optimum 0.3 to 0.6)
+	int stallGenerations;        // stop when the best fitness has not improved for this many generations (0 never)
+	double minStdDev;            // stop when the standard deviation of the fitness falls below this (0 never)
+	double timeBudgetMs;         // stop when the generations of the run have taken this long (0 never)
+	uint64_t evaluationBudget;   // stop when the run has scored this many genotypes (0 never)
+	ProductMode productMode;     // how products are computed
+	bool productCutoff;          // stop multiplying once the partial product is further above the target than the best genotype is from it
+	                             // (the genotype keeps the partial product, a lower bound; ignored with PRODUCT_LOG)
+	bool fitnessTable;           // look the fitness up in a table of every genome (PRODUCT_INT64 without cutoff, up to 26 cards),
+	                             // shared by all the instances with the same target
+	std::string fitnessTableCache;   // a folder where the tables are kept between runs (empty for none)
+	std::shared_ptr<const FitnessTable> sharedTable;   // if set, the table of the target to use instead of FitnessTable::get()
+	                                                   // (a batch holds one for all its runs, so it is not built again for each)
+	bool hardwareCounters;       // count cycles, instructions and cache misses in getStats() (Linux perf_event)
+	std::string outputPath;      // the file of the trace with OUTPUT_CSV/OUTPUT_BOTH
+	TraceFormat traceFormat;     // the format of the trace
+	bool asyncOutput;            // if the trace is written by a background thread
+	std::shared_ptr<ReportSink> reportSink;   // if set, the trace goes here instead of outputPath
+	std::string checkpointPath;  // if set, the state of the run is saved here (see saveCheckpoint())
+	int checkpointInterval;      // the generations between checkpoints (0 saves only when the run ends)
+	bool resume;                 // if the constructor resumes from checkpointPath when the file exists
+
+	GAOptions() : seed(0), populationSeed(0), threads(1), vectorize(false), selection(SELECTION_ROULETTE_BINARY), tournamentSize(2), truncationRatio(0.5), replacement(REPLACEMENT_GENERATIONAL), elitism(0), replacements(2), mutation(MUTATION_GEOMETRIC), adaptiveRates(false), diversityLow(1.0), diversityHigh(2.0),
+		stallGenerations(0), minStdDev(0), timeBudgetMs(0), evaluationBudget(0), productMode(PRODUCT_INT64), productCutoff(false), fitnessTable(false), hardwareCounters(false),
+		outputPath("output.csv"), traceFormat(TRACE_TEXT), asyncOutput(false), checkpointInterval(0), resume(false) {}
+};
+
+// the genes of a genotype packed one bit per card
+typedef uint64_t GeneWord;
+
+// a genome is a single word, so this is the largest card range we can handle
+const int MAX_CARDS = 64;
 
 struct Genotype
 {
-	vector<int> Genes; 		 // a series of 0s and 1s where if the ith digit is 0 that means that the card with the number i+1 is at the first stack, otherwise at the second
+	GeneWord Genes;          // packed genes where if the ith bit is 0 that means that the card with the number i+1 is at the first stack, otherwise at the second
 	double fitness;          // the fitness of the genotype
-	int sum, product;        // the sum of the values in the first stack and the product of the values in the second
-	double pSel, pCum;       // The probability of selection and the cumulative one for this certain genotype
-	bool willMate;           // if this genotype will mate or not 
+	int sum;                 // the sum of the values in the first stack
+	int64_t product;         // the product of the values in the second
 	
 
 	// init a new genotype
-	Genotype() {}
-	Genotype(int numOfCards) : fitness(0), pSel(0), pCum(0), willMate(false) { Genes = vector<int>(numOfCards); }
+	Genotype() : Genes(0), fitness(0), sum(0), product(0) {}
+
+	// get/flip the gene of the card with the number i+1
+	inline int getGene(int i) const { return (int)((Genes >> i) & 1); }
+	inline void flipGene(int i) { Genes ^= (GeneWord)1 << i; }
+};
+
+// the outcome of a run
+struct RunResult
+{
+	int experiment;          // the experiment of the run
+	uint64_t seed;           // the seed of the random generator of the run
+	uint64_t populationSeed; // the seed the initial population was drawn from (after restartSimulation(true), the one of
+	                         // the experiment that drew it)
+	int generations;         // the generations it took
+	bool solved;             // if a perfect genotype was found
+	Genotype best;           // the best genotype found
+	double wallTimeMs;       // the time the run took (filled in by whoever timed it)
+	double pXOver, pMutation;   // the probabilities at the end of the run (see GAOptions::adaptiveRates)
+	StopReason stopReason;   // why the run ended
+	uint64_t evaluations;    // the genotypes it scored
+
+	RunResult() : experiment(0), seed(0), populationSeed(0), generations(0), solved(false), wallTimeMs(0), pXOver(0), pMutation(0), stopReason(STOP_NONE), evaluations(0) {}
+};
+
+// where the time of an instance went since it was created (or since resetStats())
+struct GAStats
+{
+	uint64_t evaluateNs, selectNs, crossoverNs, mutateNs, reportNs;   // the time of each phase
+	uint64_t generations;    // generations run
+	uint64_t evaluations;    // genotypes scored (the ones whose cached fitness was out of date)
+	uint64_t randomDraws;    // numbers drawn from the random generator
+	uint64_t crossovers;     // pairs of genotypes that mated
+	uint64_t mutations;      // genes flipped by mutation
+	uint64_t bytesAllocated; // bytes allocated for the population (all of it at setup, a generation allocates nothing)
+	bool hardwareCounters;   // if the counts below are filled in (see GAOptions::hardwareCounters)
+	uint64_t cycles, instructions, cacheMisses;   // of the threads that advanced the generations, while they did
+
+	GAStats() : evaluateNs(0), selectNs(0), crossoverNs(0), mutateNs(0), reportNs(0), generations(0), evaluations(0), randomDraws(0),
+		crossovers(0), mutations(0), bytesAllocated(0), hardwareCounters(false), cycles(0), instructions(0), cacheMisses(0) {}
 };
 
 class CardGenAlgo {
@@ -25,25 +183,90 @@ class CardGenAlgo {
    * The class/interface for the genetic algorithm that solves our problem	 
    */
 
+	// the microbenchmark (bench/OperatorBench.cpp) times the phases of a generation one by one
+	friend class OperatorBench;
+
 private:
+	// how much of a genotype's cached evaluation is out of date
+	enum DirtyState {
+		DIRTY_NONE,      // sum, product and fitness are all valid
+		DIRTY_FITNESS,   // sum and product are valid, the fitness needs to be recomputed
+		DIRTY_GENES      // the genes changed, everything needs to be recomputed
+	};
+
+	// the totals of the evaluation of a range of genotypes
+	struct EvalPartial {
+		double totalFitness, totalFitnessSquare;
+		int bestIndex;           // the fittest genotype of the range if it beats bestFitness (-1 otherwise)
+		double bestFitness;
+		int solutionIndex;       // a genotype with a perfect score (-1 if none)
+		int evaluations;         // the genotypes that were scored
+	};
+
 	// execution properties
 	int mPopsize;
 	double mPXOver, mPMutation;
+	double mStartPXOver, mStartPMutation;   // the probabilities every experiment starts with
 	int mMaxGenerations;
 	OutputChoice mOutputChoice;
 	int mTargetSum;
-	int mTargetProd;
+	int64_t mTargetProd;
 	int mTargetCards;
 	int mOutputFreq;
+	GAOptions mOptions;
+	GeneWord mCardsMask;     // one set bit for every card in the game
 
-	// algorithm vars
-	vector<Genotype> mPopulation, mInitialPopulation;
+	// algorithm vars (the population is stored column-wise, entry i of every column belongs to genotype i)
+	vector<GeneWord> mGenes, mInitialGenes;   // the packed genes of each genotype
+	vector<double> mFitness;                  // the fitness of each genotype
+	vector<int> mSum;                         // the sum of the first stack of each genotype
+	vector<int64_t> mProduct;                 // the product of the second stack of each genotype (saturated)
+	vector<double> mProductValue;             // the product as compared with the target (PRODUCT_INT128/PRODUCT_LOG only)
+	vector<double> mCumProb;                  // the cumulative probability of selection (or the alias probability with SELECTION_ROULETTE_ALIAS)
+	vector<int> mAlias;                       // the alias of each genotype with SELECTION_ROULETTE_ALIAS
+	vector<int> mSurvivors;                   // the indices of the genotypes that pass to the next generation
+	vector<int> mRanked;                      // the indices of the genotypes ordered by fitness (SELECTION_RANK/SELECTION_TRUNCATION/elitism),
+	                                          // or of the offspring of the last step (REPLACEMENT_STEADY_STATE)
+	vector<char> mWillMate;                   // if each genotype will mate or not
+	vector<double> mRandoms;                  // random numbers drawn in bulk for the current phase
+	vector<int> mBatchIndex, mBatchSum;       // the genotypes whose genes changed, packed for the kernel in evaluate()
+	vector<int64_t> mBatchProduct;
+	vector<GeneWord> mBatchGenes;
+	vector<char> mDirty;                      // what needs to be recomputed for each genotype in the next evaluation (see DirtyState)
+	vector<GeneWord> mNextGenes;              // the back buffers of the columns above: select() gathers the survivors
+	vector<double> mNextFitness, mNextProductValue;   // into them and swaps them with the front, so a generation allocates nothing
+	vector<int> mNextSum;
+	vector<int64_t> mNextProduct;
+	vector<char> mNextDirty;
+	vector<int> mHeap;                        // the genotypes in a heap with the least fit on top (REPLACEMENT_STEADY_STATE, empty until built)
+	GenomeSet mGenomes;                       // the genes of the population along with the heap, so that no offspring is a copy
 	Genotype bestGenotype;
 	int bestGenotypeIndex;
 	int mCurrentGen, mCurrentExp;
 	double totalFitness;
 	double totalFitnessSquare;
 	bool solutionFound;
+	StopReason mStopReason;  // why the run ended (STOP_NONE while it goes on)
+	int mLastImprovement;    // the generation the best fitness last improved in
+	uint64_t mEvaluations;   // the genotypes scored in the run
+	double mRunTimeMs;       // the time its generations took (kept with a time budget only)
+	uint64_t mSeed;          // the seed of the first experiment, experiment n uses mSeed + n - 1
+	uint64_t mPopulationSeed;   // the seed the initial population was drawn from
+	int64_t mTraceBytes;     // the size of the trace at the checkpoint the run resumed from (-1 for none)
+	RandomGenerator mRng;
+	std::unique_ptr<ThreadPool> mPool;   // the workers of evaluate() (null when running on one thread)
+	vector<EvalPartial> mPartials;       // the results of each block of the population in evaluate()
+	std::shared_ptr<ReportSink> mSink;   // where the trace goes (null unless writing to a file)
+	bool mExactProduct;      // if every product is exact (so mutations can update it by division)
+	EvalKernel mKernel;      // computes the sums and products of the genotypes (null with a product cutoff or a mode other than PRODUCT_INT64)
+	int64_t mProductCutoff;  // products above this are not computed further (INT64_MAX unless productCutoff is set)
+	double mTargetProdValue; // the target product in the units of mProductValue
+	vector<double> mLogCard; // the logarithm of every card (PRODUCT_LOG)
+	std::shared_ptr<const FitnessTable> mTable;   // the fitness of every genome (null unless fitnessTable is set)
+	GAStats mStats;
+	std::unique_ptr<PerfCounters> mPerf;   // the hardware counters (null until the first advance with hardwareCounters)
+	std::thread::id mPerfThread;           // the thread they count
+	uint64_t mPerfBase[3];                 // the counts of the threads that advanced the generations before it
 	
 
 	// population initialization
@@ -51,24 +274,55 @@ private:
 
 	// core functions
 	bool evaluate();
+	void computeBatch(int from, int batch);
+	void evaluateRange(int from, int to, EvalPartial& partial, const std::atomic<int>* firstSolution);
 	void select();
 	void crossover();
 	void mutate();
 
 	// aux functions
 	void checkForInputErrors();
+	void initSeed();
 	void initVars();
+	void initPool();
+	void initOutput(bool append);
+	bool runGeneration();
+	void adaptRates();
+	StopReason checkStop() const;
+	void startCounters();
+	void checkpointIfDue(bool ended);
+	size_t columnBytes() const;
 	inline double randZeroToOne();
-	inline double getEuclideanDistance(int sum, int product);
+	inline int randIndex(int n);
+	inline double getEuclideanDistance(int sum, double product);
+	void computeSumProduct(GeneWord genes, int& sum, int64_t& product, double& productValue);
 	void setBestGenotype(int);
+	void selectRoulette();
+	void selectTournament();
+	void selectStochasticUniversal();
+	void selectRank();
+	void selectTruncation();
+	void buildAliasTable();
+	int drawSurvivor(double roulette);
 	void mateGenotypes(int, int, int);
+	void mutatePerGene();
+	void mutateGeometric();
+	void mutateWordMask();
+	void mutateGenotype(int);
+	bool evaluateOffspring();
+	void selectSteadyState();
+	inline double scoreGenotype(int);
+	void flipGene(int, int);
+	void flipGenes(int, GeneWord);
+	inline GeneWord randWord();
 	void displayDataAndReport(bool);
+	void printGeneration(const char* title, double avg, double stddev);
 
 public:
 	// Normal constructor (Target sum: 36, Target Product: 360, Cards: 1-10)
-	CardGenAlgo(int popSize, double pXOver, double pMutation, int maxGenerations, OutputChoice outputChoice, int outputFreq);
+	CardGenAlgo(int popSize, double pXOver, double pMutation, int maxGenerations, OutputChoice outputChoice, int outputFreq, const GAOptions& options = GAOptions());
 	// Custom constructor (target sum/product as well as cards, decided by user)
-	CardGenAlgo(int sum, int prod, int totalCards, int popSize, double pXOver, double pMutation, int maxGenerations, OutputChoice outputChoice, int outputFreq);
+	CardGenAlgo(int sum, int64_t prod, int totalCards, int popSize, double pXOver, double pMutation, int maxGenerations, OutputChoice outputChoice, int outputFreq, const GAOptions& options = GAOptions());
 
 
 	// interact with outside world
@@ -76,4 +330,17 @@ public:
 	int advanceToFinalGeneration();
 	void restartSimulation(bool samePopulation);
 	void reportGeneration();
+	uint64_t getSeed() const { return mSeed; }
+	RunResult getResult() const;
+	GAStats getStats() const;
+	void resetStats();
+
+	// save the whole state of the run (population, best genotype, counters, parameters and random generator) to a file,
+	// and resume from one (of the same problem, population size and product mode)
+	void saveCheckpoint(const std::string& path) const;
+	void loadCheckpoint(const std::string& path);
+
+	// exchange genotypes with other instances (see IslandModel)
+	void getEmigrants(int count, vector<GeneWord>& genes) const;
+	void acceptImmigrants(const vector<GeneWord>& genes);
 };
\ No newline at end of file
@@ -0,0 +1,43 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <memory>
+
+using std::vector;
+
+// 2^26 fitness values take 512MB, more than that is not worth it
+const int MAX_TABLE_CARDS = 26;
+
+class FitnessTable {
+  /*
+   * The fitness of every genome of a (sum, product, cards) target, indexed by the packed genes.
+   * Built once (in parallel, or loaded from a cache file) and shared read-only by every CardGenAlgo
+   * instance with the same target, through get().
+   * The fitness is 1 / distance of the sum and the 64 bit product to the target, as in CardGenAlgo
+   * with PRODUCT_INT64, stored as a double so that a run gives the same results with and without the table.
+   * A perfect genome has a fitness of 0 in the table.
+   */
+
+private:
+	int mSum;
+	int64_t mProduct;
+	int mCards;
+	vector<double> mFitness;
+
+	FitnessTable(int sum, int64_t prod, int cards);
+
+	void build();
+	bool load(const std::string& path);
+	void save(const std::string& path) const;
+
+public:
+	// the table of the target, built on first use (cacheDir is a folder for table files, empty for none)
+	static std::shared_ptr<const FitnessTable> get(int sum, int64_t prod, int cards, const std::string& cacheDir);
+
+	inline double fitness(uint64_t genes) const { return mFitness[genes]; }
+	int getSum() const { return mSum; }
+	int64_t getProduct() const { return mProduct; }
+	int getCards() const { return mCards; }
+};
@@ -0,0 +1,58 @@
+#include "GenomeSet.h"
+
+
+void GenomeSet::reset(int capacity) {
+
+	// at most half full, so the probes stay short
+	size_t slots = 2;
+	int bits = 1;
+	while (slots < 2 * (size_t)capacity) {
+		slots *= 2;
+		bits++;
+	}
+
+	mKeys.assign(slots, 0);
+	mCounts.assign(slots, 0);
+	mMask = slots - 1;
+	mShift = 64 - bits;
+}
+
+// the slot of genes, or the empty slot where it would go
+size_t GenomeSet::find(uint64_t genes) const {
+
+	size_t i = home(genes);
+	while (mCounts[i] > 0 && mKeys[i] != genes)
+		i = (i + 1) & mMask;
+	return i;
+}
+
+void GenomeSet::insert(uint64_t genes) {
+
+	size_t i = find(genes);
+	mKeys[i] = genes;
+	mCounts[i]++;
+}
+
+void GenomeSet::erase(uint64_t genes) {
+
+	size_t i = find(genes), j = i, k;
+
+	if (mCounts[i] == 0 || --mCounts[i] > 0)
+		return;
+
+	// the keys after the hole that probed past it move back into it, so no probe stops early
+	while (true) {
+		j = (j + 1) & mMask;
+		if (mCounts[j] == 0)
+			break;
+
+		// k is where the key at j would like to be, it may move to i unless k lies cyclically in (i, j]
+		k = home(mKeys[j]);
+		if ((i < j) ? (k <= i || k > j) : (k <= i && k > j)) {
+			mKeys[i] = mKeys[j];
+			mCounts[i] = mCounts[j];
+			mCounts[j] = 0;
+			i = j;
+		}
+	}
+}
@@ -0,0 +1,63 @@
+#pragma once
+
+#include <vector>
+#include <memory>
+
+#include "CardGenAlgo.h"
+#include "BatchRunner.h"
+#include "RandomGenerator.h"
+#include "ThreadPool.h"
+
+using std::vector;
+
+// which island sends its migrants to which
+enum MigrationTopology {
+	TOPOLOGY_RING,     // island i receives from island i-1
+	TOPOLOGY_RANDOM    // every island receives from a random other island, drawn at every migration
+};
+
+// the settings of the island model
+struct IslandOptions
+{
+	int islands;                 // the number of sub-populations (each config.popSize big)
+	int migrationInterval;       // the generations between two migrations
+	int migrants;                // the genotypes every island sends at each migration
+	MigrationTopology topology;
+	int threads;                 // the threads the islands evolve on (0 uses every core)
+
+	IslandOptions() : islands(4), migrationInterval(20), migrants(2), topology(TOPOLOGY_RING), threads(0) {}
+};
+
+class IslandModel {
+  /*
+   * K sub-populations that evolve independently on their own threads and periodically send
+   * copies of their best genotypes to each other.
+   * Between migrations the islands share nothing. At a migration the emigrants of every island are
+   * first copied out into their own buffer and only then handed to the receivers, so no island
+   * reads a population that is being modified.
+   */
+
+private:
+	ExperimentConfig mConfig;
+	IslandOptions mIslandOptions;
+	vector<std::unique_ptr<CardGenAlgo> > mIslands;
+	vector<vector<GeneWord> > mEmigrants;   // the outgoing genotypes of each island
+	vector<int> mSources;                   // the island each island receives from
+	std::unique_ptr<ThreadPool> mPool;
+	RandomGenerator mRng;
+	int mCurrentGen;
+	double mWallTimeMs;
+
+	void migrate();
+
+public:
+	IslandModel(const ExperimentConfig& config, const IslandOptions& islandOptions);
+
+	// evolve until an island finds a perfect genotype or config.maxGenerations are reached
+	int advanceToFinalGeneration();
+
+	// the best result over all islands
+	RunResult getResult() const;
+	// the result of every island
+	vector<RunResult> getIslandResults() const;
+};
@@ -0,0 +1,81 @@
+#include "MappedFile.h"
+
+#include <stdexcept>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+
+MappedFile::MappedFile(const std::string& path) : mData(nullptr), mLength(0)
+{
+#ifdef _WIN32
+	mMapping = nullptr;
+	mFileHandle = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+	if (mFileHandle == INVALID_HANDLE_VALUE)
+		throw std::invalid_argument("Could not open " + path);
+
+	LARGE_INTEGER length;
+	GetFileSizeEx(mFileHandle, &length);
+	mLength = (size_t)length.QuadPart;
+
+	if (mLength > 0) {
+		mMapping = CreateFileMappingA(mFileHandle, nullptr, PAGE_READONLY, 0, 0, nullptr);
+		if (mMapping)
+			mData = (const unsigned char*)MapViewOfFile(mMapping, FILE_MAP_READ, 0, 0, 0);
+	}
+#else
+	mFile = open(path.c_str(), O_RDONLY);
+	if (mFile < 0)
+		throw std::invalid_argument("Could not open " + path);
+
+	struct stat st;
+	fstat(mFile, &st);
+	mLength = (size_t)st.st_size;
+
+	if (mLength > 0) {
+		void* data = mmap(nullptr, mLength, PROT_READ, MAP_SHARED, mFile, 0);
+		if (data != MAP_FAILED) {
+			mData = (const unsigned char*)data;
+			// the files are read front to back
+			madvise(data, mLength, MADV_SEQUENTIAL);
+		}
+	}
+#endif
+
+	if (mLength > 0 && !mData) {
+		close();
+		throw std::invalid_argument("Could not map " + path);
+	}
+}
+
+MappedFile::~MappedFile() {
+	close();
+}
+
+void MappedFile::close() {
+#ifdef _WIN32
+	if (mData)
+		UnmapViewOfFile(mData);
+	if (mMapping)
+		CloseHandle(mMapping);
+	if (mFileHandle != INVALID_HANDLE_VALUE)
+		CloseHandle(mFileHandle);
+	mMapping = nullptr;
+	mFileHandle = INVALID_HANDLE_VALUE;
+#else
+	if (mData)
+		munmap((void*)mData, mLength);
+	if (mFile >= 0)
+		::close(mFile);
+	mFile = -1;
+#endif
+	mData = nullptr;
+}
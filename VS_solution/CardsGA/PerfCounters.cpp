@@ -0,0 +1,90 @@
+#include "PerfCounters.h"
+
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <cstring>
+
+// the events of the group, the first one leads it
+static const uint64_t PERF_EVENTS[3] = { PERF_COUNT_HW_CPU_CYCLES, PERF_COUNT_HW_INSTRUCTIONS, PERF_COUNT_HW_CACHE_MISSES };
+
+PerfCounters::PerfCounters() {
+
+	for (int i = 0; i < 3; ++i)
+		mFds[i] = -1;
+
+	for (int i = 0; i < 3; ++i) {
+		struct perf_event_attr attr;
+		memset(&attr, 0, sizeof(attr));
+		attr.size = sizeof(attr);
+		attr.type = PERF_TYPE_HARDWARE;
+		attr.config = PERF_EVENTS[i];
+		attr.disabled = (i == 0);    // the group starts with its leader
+		attr.exclude_kernel = 1;
+		attr.exclude_hv = 1;
+		attr.read_format = PERF_FORMAT_GROUP;
+
+		mFds[i] = (int)syscall(__NR_perf_event_open, &attr, 0, -1, (i == 0) ? -1 : mFds[0], 0);
+		if (mFds[i] < 0) {
+			// all or nothing
+			close();
+			return;
+		}
+	}
+}
+
+PerfCounters::~PerfCounters() {
+	close();
+}
+
+void PerfCounters::close() {
+	for (int i = 0; i < 3; ++i) {
+		if (mFds[i] >= 0)
+			::close(mFds[i]);
+		mFds[i] = -1;
+	}
+}
+
+void PerfCounters::start() {
+	if (available())
+		ioctl(mFds[0], PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+}
+
+void PerfCounters::stop() {
+	if (available())
+		ioctl(mFds[0], PERF_EVENT_IOC_DISABLE, PERF_IOC_FLAG_GROUP);
+}
+
+void PerfCounters::read(uint64_t& cycles, uint64_t& instructions, uint64_t& cacheMisses) const {
+
+	// the number of events followed by their counts
+	uint64_t values[4] = { 0, 0, 0, 0 };
+
+	cycles = instructions = cacheMisses = 0;
+	if (!available() || ::read(mFds[0], values, sizeof(values)) != (ssize_t)sizeof(values))
+		return;
+
+	cycles = values[1];
+	instructions = values[2];
+	cacheMisses = values[3];
+}
+
+#else
+
+PerfCounters::PerfCounters() {
+	for (int i = 0; i < 3; ++i)
+		mFds[i] = -1;
+}
+
+PerfCounters::~PerfCounters() {}
+void PerfCounters::close() {}
+void PerfCounters::start() {}
+void PerfCounters::stop() {}
+
+void PerfCounters::read(uint64_t& cycles, uint64_t& instructions, uint64_t& cacheMisses) const {
+	cycles = instructions = cacheMisses = 0;
+}
+
+#endif
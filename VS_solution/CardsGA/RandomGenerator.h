@@ -0,0 +1,67 @@
+#pragma once
+
+#include <cstdint>
+
+class RandomGenerator {
+  /*
+   * xoshiro256** pseudo random number generator (Blackman & Vigna), seeded through splitmix64.
+   * Small and fast, so every CardGenAlgo instance owns one and runs are reproducible from their seed.
+   */
+
+private:
+	uint64_t mState[4];
+
+	static inline uint64_t rotl(uint64_t x, int k) { return (x << k) | (x >> (64 - k)); }
+
+public:
+	RandomGenerator() { seed(0); }
+	explicit RandomGenerator(uint64_t s) { seed(s); }
+
+	// expand a single 64 bit seed into the whole state
+	void seed(uint64_t s) {
+		for (int i = 0; i < 4; ++i) {
+			uint64_t z = (s += 0x9E3779B97F4A7C15ULL);
+			z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+			z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+			mState[i] = z ^ (z >> 31);
+		}
+	}
+
+	// the whole state, so a generator can be saved and resumed (see CardGenAlgo::saveCheckpoint)
+	void getState(uint64_t state[4]) const {
+		for (int i = 0; i < 4; ++i)
+			state[i] = mState[i];
+	}
+
+	void setState(const uint64_t state[4]) {
+		for (int i = 0; i < 4; ++i)
+			mState[i] = state[i];
+	}
+
+	// the next 64 random bits
+	inline uint64_t next() {
+		const uint64_t result = rotl(mState[1] * 5, 7) * 9;
+		const uint64_t t = mState[1] << 17;
+
+		mState[2] ^= mState[0];
+		mState[3] ^= mState[1];
+		mState[1] ^= mState[2];
+		mState[0] ^= mState[3];
+		mState[2] ^= t;
+		mState[3] = rotl(mState[3], 45);
+
+		return result;
+	}
+
+	// a random double in [0,1) with 53 random bits
+	inline double nextDouble() { return (next() >> 11) * (1.0 / 9007199254740992.0); }
+
+	// a random integer in [0,n) (n must be below 2^32)
+	inline uint32_t nextBelow(uint32_t n) { return (uint32_t)(((next() >> 32) * n) >> 32); }
+
+	// fill a buffer with random doubles in [0,1)
+	void fillDoubles(double* out, int n) {
+		for (int i = 0; i < n; ++i)
+			out[i] = nextDouble();
+	}
+};
@@ -0,0 +1,160 @@
+#include "ReportSink.h"
+
+#include <stdexcept>
+
+#ifdef _WIN32
+#include <io.h>
+#include <fcntl.h>
+#include <share.h>
+#include <sys/stat.h>
+#else
+#include <unistd.h>
+#endif
+
+// the size of the buffer of the text trace
+static const size_t CSV_BUFFER_SIZE = 1 << 20;
+
+
+CsvReportSink::CsvReportSink(const std::string& path, bool append) : mPath(path), mBuffer(CSV_BUFFER_SIZE), mCards(0)
+{
+	mAppend = append && std::ifstream(mPath.c_str()).peek() != std::ifstream::traits_type::eof();
+
+	// the buffer has to be set before the file is opened
+	mFile.rdbuf()->pubsetbuf(&mBuffer[0], (std::streamsize)mBuffer.size());
+	mFile.open(mPath.c_str(), std::ofstream::out | (append ? std::ofstream::app : std::ofstream::trunc));
+
+	if (!mFile)
+		throw std::invalid_argument("Could not open " + mPath + " for writing");
+}
+
+CsvReportSink::~CsvReportSink() {
+	mFile.flush();
+}
+
+void CsvReportSink::begin(const TraceInfo& info) {
+	mCards = info.cards;
+	if (mAppend)
+		return;
+
+	mFile << "Exp Gen TotFitness AvgFitness StdDev ";
+	for (int i = 0; i < mCards; ++i)
+		mFile << "Card" << i+1 << " ";
+	mFile << "BestGenoSum BestGenoProd BestGenoFitness\n";
+}
+
+void CsvReportSink::write(const GenerationRecord& record) {
+	mFile << record.experiment << " " << record.generation << " " << record.totalFitness << " " << record.avgFitness << " " << record.stdDev << " ";
+	for (int i = 0; i < mCards; ++i)
+		mFile << ((record.bestGenes >> i) & 1) << " ";
+	mFile << record.bestSum << " " << record.bestProduct << " " << record.bestFitness << "\n";
+}
+
+void CsvReportSink::flush() {
+	mFile.flush();
+}
+
+int64_t CsvReportSink::bytesWritten() {
+	flush();
+	return fileBytes(mPath);
+}
+
+
+int64_t fileBytes(const std::string& path) {
+	std::ifstream file(path.c_str(), std::ifstream::binary | std::ifstream::ate);
+
+	return file ? (int64_t)file.tellg() : -1;
+}
+
+void truncateTrace(const std::string& path, int64_t bytes) {
+
+	if (bytes < 0 || fileBytes(path) <= bytes)
+		return;
+
+#ifdef _WIN32
+	int fd = -1;
+	bool done = _sopen_s(&fd, path.c_str(), _O_RDWR | _O_BINARY, _SH_DENYNO, _S_IREAD | _S_IWRITE) == 0;
+	if (done) {
+		done = _chsize_s(fd, bytes) == 0;
+		_close(fd);
+	}
+#else
+	bool done = truncate(path.c_str(), (off_t)bytes) == 0;
+#endif
+
+	if (!done)
+		throw std::invalid_argument("Could not truncate " + path);
+}
+
+
+AsyncReportSink::AsyncReportSink(std::unique_ptr<ReportSink> sink) : mSink(std::move(sink)), mStop(false), mWriterBusy(false)
+{
+	mWriter = std::thread(&AsyncReportSink::writerLoop, this);
+}
+
+AsyncReportSink::~AsyncReportSink() {
+	{
+		std::lock_guard<std::mutex> lock(mMutex);
+		mStop = true;
+	}
+	mWake.notify_one();
+	mWriter.join();
+
+	mSink->flush();
+}
+
+void AsyncReportSink::begin(const TraceInfo& info) {
+	// nothing has been queued yet, so the writer thread is not touching the sink
+	std::lock_guard<std::mutex> lock(mMutex);
+	mSink->begin(info);
+}
+
+void AsyncReportSink::write(const GenerationRecord& record) {
+	bool wasEmpty;
+	{
+		std::lock_guard<std::mutex> lock(mMutex);
+		wasEmpty = mPending.empty();
+		mPending.push_back(record);
+	}
+	if (wasEmpty)
+		mWake.notify_one();
+}
+
+void AsyncReportSink::flush() {
+	std::unique_lock<std::mutex> lock(mMutex);
+	mDrained.wait(lock, [this] { return mPending.empty() && !mWriterBusy; });
+	mSink->flush();
+}
+
+int64_t AsyncReportSink::bytesWritten() {
+	std::unique_lock<std::mutex> lock(mMutex);
+	mDrained.wait(lock, [this] { return mPending.empty() && !mWriterBusy; });
+	return mSink->bytesWritten();
+}
+
+void AsyncReportSink::writerLoop() {
+
+	while (true) {
+		{
+			std::unique_lock<std::mutex> lock(mMutex);
+			mWake.wait(lock, [this] { return mStop || !mPending.empty(); });
+
+			if (mPending.empty()) {
+				// stopping with nothing left to write
+				return;
+			}
+
+			mWriting.swap(mPending);
+			mWriterBusy = true;
+		}
+
+		for (size_t i = 0; i < mWriting.size(); ++i)
+			mSink->write(mWriting[i]);
+		mWriting.clear();
+
+		{
+			std::lock_guard<std::mutex> lock(mMutex);
+			mWriterBusy = false;
+		}
+		mDrained.notify_all();
+	}
+}
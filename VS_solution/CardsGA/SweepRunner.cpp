@@ -0,0 +1,107 @@
+#include "SweepRunner.h"
+
+#include <mutex>
+#include <exception>
+
+#include "ThreadPool.h"
+#include "Timing.h"
+
+
+vector<ExperimentConfig> SweepConfig::grid() const {
+
+	vector<int> popSizeValues = popSizes.empty() ? vector<int>(1, base.popSize) : popSizes;
+	vector<double> pXOverValues = pXOvers.empty() ? vector<double>(1, base.pXOver) : pXOvers;
+	vector<double> pMutationValues = pMutations.empty() ? vector<double>(1, base.pMutation) : pMutations;
+	vector<int> maxGenerationValues = maxGenerations.empty() ? vector<int>(1, base.maxGenerations) : maxGenerations;
+	vector<ExperimentConfig> points;
+
+	for (size_t a = 0; a < popSizeValues.size(); ++a)
+		for (size_t b = 0; b < pXOverValues.size(); ++b)
+			for (size_t c = 0; c < pMutationValues.size(); ++c)
+				for (size_t d = 0; d < maxGenerationValues.size(); ++d) {
+					ExperimentConfig point = base;
+					point.popSize = popSizeValues[a];
+					point.pXOver = pXOverValues[b];
+					point.pMutation = pMutationValues[c];
+					point.maxGenerations = maxGenerationValues[d];
+					points.push_back(point);
+				}
+
+	return points;
+}
+
+
+SweepRunner::SweepRunner(const SweepConfig& sweep, int threads) : mSweep(sweep), mThreads(BatchRunner::threadCount(threads))
+{
+	// one base seed and fitness table for every point
+	mSweep.base = BatchRunner::batchConfig(mSweep.base);
+}
+
+SweepReport SweepRunner::run(int experiments, bool samePopulation) const {
+
+	SweepReport report = SweepReport();
+	std::exception_ptr error;
+	std::mutex errorMutex;
+
+	report.points = mSweep.grid();
+	report.batches.resize(report.points.size());
+	for (size_t p = 0; p < report.points.size(); ++p) {
+		report.batches[p].runs.resize(experiments);
+		// and so does every point
+		if (!report.points[p].options.checkpointPath.empty())
+			report.points[p].options.checkpointPath += "." + std::to_string(p);
+	}
+
+	int tasks = (int)report.points.size() * experiments;
+	ThreadPool pool(mThreads < tasks ? mThreads : (tasks > 0 ? tasks : 1));
+
+	TimeVar now = timeNow();
+
+	// task t is experiment t % experiments + 1 of point t / experiments
+	pool.run(tasks, [&](int t) {
+		{
+			// after an error the remaining experiments are skipped
+			std::lock_guard<std::mutex> lock(errorMutex);
+			if (error)
+				return;
+		}
+
+		try {
+			int point = t / experiments, experiment = t % experiments;
+			report.batches[point].runs[experiment] = BatchRunner::runExperiment(report.points[point], experiment + 1, samePopulation);
+		}
+		catch (...) {
+			// handed to the caller once every thread is done
+			std::lock_guard<std::mutex> lock(errorMutex);
+			if (!error)
+				error = std::current_exception();
+		}
+	});
+
+	if (error)
+		std::rethrow_exception(error);
+
+	report.totalWallTimeMs = durationMs(timeNow() - now);
+
+	// the points share the threads, so only the sweep as a whole has a wall time
+	for (size_t p = 0; p < report.batches.size(); ++p)
+		BatchRunner::summarize(report.batches[p]);
+
+	return report;
+}
+
+void SweepRunner::writeReport(const SweepReport& report, std::ostream& out) {
+
+	out << "PopSize PXOver PMutation MaxGenerations Experiments Solved SolvedRatio AvgGenerations AvgBestFitness AvgTimeMs\n";
+	for (size_t p = 0; p < report.points.size(); ++p) {
+		const ExperimentConfig& point = report.points[p];
+		const BatchReport& batch = report.batches[p];
+		double experiments = (double)batch.runs.size();
+
+		out << point.popSize << " " << point.pXOver << " " << point.pMutation << " " << point.maxGenerations << " "
+			<< batch.runs.size() << " " << batch.solvedRuns << " " << (experiments > 0 ? batch.solvedRuns / experiments : 0) << " "
+			<< batch.avgGenerations << " " << batch.avgBestFitness << " " << batch.avgWallTimeMs << "\n";
+	}
+
+	out << "# points: " << report.points.size() << ", total time: " << report.totalWallTimeMs << " ms\n";
+}
@@ -0,0 +1,54 @@
+#pragma once
+
+#include <vector>
+#include <ostream>
+
+#include "BatchRunner.h"
+
+using std::vector;
+
+// a grid of algorithm parameters around a base config, every combination of the values is a point of the sweep
+// (an empty list keeps the value of the base config)
+struct SweepConfig
+{
+	ExperimentConfig base;
+	vector<int> popSizes;
+	vector<double> pXOvers;
+	vector<double> pMutations;
+	vector<int> maxGenerations;
+
+	// the configs of all the points, popSize varying slowest and maxGenerations fastest
+	vector<ExperimentConfig> grid() const;
+};
+
+// the results of a sweep, one batch per point
+struct SweepReport
+{
+	vector<ExperimentConfig> points;
+	vector<BatchReport> batches;
+	double totalWallTimeMs;
+
+	SweepReport() : totalWallTimeMs(0) {}
+};
+
+class SweepRunner {
+  /*
+   * Runs the same batch of experiments for every point of a parameter grid. All the experiments of all the points
+   * are spread over one set of threads, so small batches still keep every core busy.
+   * Every point uses the same seeds (experiment n of every point runs with seed + n - 1), so the points are compared
+   * on the same random numbers.
+   */
+
+private:
+	SweepConfig mSweep;
+	int mThreads;
+
+public:
+	// threads is the number of experiments that run at the same time (0 uses every core)
+	SweepRunner(const SweepConfig& sweep, int threads);
+
+	SweepReport run(int experiments, bool samePopulation) const;
+
+	// one line per point with its parameters and the averages of its batch
+	static void writeReport(const SweepReport& report, std::ostream& out);
+};
@@ -0,0 +1,47 @@
+#pragma once
+
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <functional>
+
+using std::vector;
+
+class ThreadPool {
+  /*
+   * A fixed set of worker threads that is kept alive between jobs.
+   * A job is a number of independent tasks that are handed out to the workers (and the calling thread)
+   * one at a time, run() returns once all of them are done.
+   */
+
+private:
+	vector<std::thread> mWorkers;
+	std::mutex mMutex;
+	std::condition_variable mWake, mDone;
+
+	// the current job
+	const std::function<void(int)>* mTask;
+	int mTasks;
+	std::atomic<int> mNextTask;
+	int mBusy;               // workers that have not finished the current job yet
+	unsigned long mJob;      // increases with every job, so the workers know there is a new one
+	bool mStop;
+
+	void workerLoop();
+	void runTasks();
+
+public:
+	// threads is the total number of threads that work on a job, including the caller of run()
+	explicit ThreadPool(int threads);
+	~ThreadPool();
+
+	ThreadPool(const ThreadPool&) = delete;
+	ThreadPool& operator=(const ThreadPool&) = delete;
+
+	int size() const { return (int)mWorkers.size() + 1; }
+
+	// call task(i) for every i in [0,tasks) and wait for all of them to finish
+	void run(int tasks, const std::function<void(int)>& task);
+};
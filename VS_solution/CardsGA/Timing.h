@@ -0,0 +1,21 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+
+// the clock the run times are read from
+typedef std::chrono::steady_clock::time_point TimeVar;
+
+inline TimeVar timeNow() {
+	return std::chrono::steady_clock::now();
+}
+
+// an interval in ms (to the microsecond)
+inline double durationMs(std::chrono::steady_clock::duration interval) {
+	return std::chrono::duration_cast<std::chrono::microseconds>(interval).count() / 1000.0;
+}
+
+// an interval in ns
+inline int64_t durationNs(std::chrono::steady_clock::duration interval) {
+	return (int64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(interval).count();
+}
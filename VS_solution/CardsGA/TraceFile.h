@@ -0,0 +1,114 @@
+#pragma once
+
+#include "ReportSink.h"
+#include "MappedFile.h"
+
+#include <cstdint>
+#include <fstream>
+#include <string>
+#include <vector>
+
+using std::vector;
+
+// the first bytes of every binary trace
+const char TRACE_MAGIC[8] = { 'C', 'G', 'A', 'T', 'R', 'A', 'C', 'E' };
+const uint32_t TRACE_VERSION = 2;
+
+// the header at the start of a binary trace, followed by blocks up to the end of the file
+// (fields are in the byte order of the machine that wrote them, little endian everywhere we build)
+struct TraceHeader
+{
+	char magic[8];
+	uint32_t version;
+	uint32_t recordSize;     // sizeof(TraceRecord) of the writer
+	int32_t cards;
+	int32_t sum;
+	int64_t product;
+	int32_t popSize;
+	int32_t blockSize;       // sizeof(TraceBlock) of the writer
+	uint64_t seed;
+};
+
+// the start of a run of records that share their experiment and best genotype and whose generations are evenly
+// spaced, followed by its records (the best genotype changes a few dozen times in a run, so the blocks stay rare)
+struct TraceBlock
+{
+	int32_t experiment;
+	int32_t generation;      // of the first record
+	int32_t step;            // between the generations of the records
+	uint32_t records;
+	uint64_t bestGenes;      // packed, bit i is the stack of card i+1
+	int64_t bestProduct;
+	int32_t bestSum;
+	float bestFitness;
+};
+
+// the report of a generation in a binary trace, 8 bytes for any card range
+// (the average fitness is not stored, it is totalFitness / popSize; the floats keep more digits than the text trace prints)
+struct TraceRecord
+{
+	float totalFitness;
+	float stdDev;
+};
+
+static_assert(sizeof(TraceHeader) == 48, "the trace header must not be padded");
+static_assert(sizeof(TraceBlock) == 40, "the trace block must not be padded");
+static_assert(sizeof(TraceRecord) == 8, "the trace record must not be padded");
+
+class BinaryReportSink : public ReportSink {
+  /*
+   * Writes the trace as a TraceHeader followed by TraceBlocks of TraceRecords.
+   * The records of the open block are collected in memory, a block is written when the next record
+   * does not belong to it, when it is full and on flush().
+   */
+
+private:
+	std::string mPath;
+	std::ofstream mFile;
+	TraceBlock mBlock;       // the open block, its records are the ones in mBuffer
+	vector<TraceRecord> mBuffer;
+	bool mAppend;            // if the file already has its header
+
+	void writeBuffer();
+
+public:
+	// append goes on with the trace in the file (of a resumed run) instead of starting a new one
+	explicit BinaryReportSink(const std::string& path, bool append = false);
+	~BinaryReportSink();
+
+	void begin(const TraceInfo& info);
+	void write(const GenerationRecord& record);
+	void flush();
+	int64_t bytesWritten();
+};
+
+class TraceReader {
+  /*
+   * Maps a binary trace into memory, so the blocks and the records can be read in place without loading the file.
+   * Opening it walks the block headers once to index them.
+   */
+
+private:
+	MappedFile mFile;
+	vector<const TraceBlock*> mBlocks;
+	vector<size_t> mFirstRecords;   // the index of the first record of every block
+	size_t mRecords;
+
+public:
+	explicit TraceReader(const std::string& path);
+
+	const TraceHeader& header() const { return *(const TraceHeader*)mFile.data(); }
+	size_t size() const { return mRecords; }
+	size_t blocks() const { return mBlocks.size(); }
+	// the blocks, in the order they were written (the records of block b follow it, a trace cut short by a crash
+	// keeps the complete ones of its last block)
+	const TraceBlock& block(size_t b) const { return *mBlocks[b]; }
+	size_t blockRecords(size_t b) const { return ((b + 1 < mBlocks.size()) ? mFirstRecords[b + 1] : mRecords) - mFirstRecords[b]; }
+	const TraceRecord* records(size_t b) const { return (const TraceRecord*)(mBlocks[b] + 1); }
+
+	TraceInfo info() const;
+	GenerationRecord record(size_t i) const;
+
+	// write every record to another sink (a CsvReportSink gives back the text trace)
+	void exportTo(ReportSink& sink) const;
+};
@@ -1,18 +1,15 @@
 // the demo file
 #include <cstdint>
 #include <limits>
-#include <chrono>
 
 #include "CardGenAlgo.h"
+#include "BatchRunner.h"
+#include "ExactSolver.h"
 
 #include <iostream>
 #include <string>
 #include <sstream>
-
-
-typedef std::chrono::high_resolution_clock::time_point TimeVar;                        
-#define duration(a) std::chrono::duration_cast<std::chrono::milliseconds>(a).count()   
-#define timeNow() std::chrono::high_resolution_clock::now()                            
+#include <fstream>
 
 
 using namespace std;
@@ -143,7 +140,7 @@ void reportChoices() {
 
 }
 
-void manualRun(CardGenAlgo cga) {
+void manualRun(CardGenAlgo& cga) {
 	int cgen=0, cexp=1;
 	int sel;
 
@@ -185,30 +182,35 @@ void manualRun(CardGenAlgo cga) {
 	} while (sel != 5);
 }
 
-void automatedRun(CardGenAlgo cga) {
-	int cexp=1;
-	double dur = 0;
+void automatedRun(const ExperimentConfig& config, OutputChoice output) {
 	
 	cout << "> About to start the experiments. ";
 	waitUserInput();
 
 	cout << "> Execution began!\n";
-	
-	TimeVar now;
 
-	do {
-		cout << "> Curr Exp: " << cexp << endl;
-		now = timeNow();
-		cga.advanceToFinalGeneration();
-		dur += duration(timeNow() - now);
-		if (cexp == numberOfExperiments)
-			break;
-		cga.restartSimulation(sel4 == 1 ? true : false);
-		cexp++;
-	} while (true);
+	// the exact solver tells us first if there is anything to find
+	vector<GeneWord> solutions = ExactSolver(config.sum, config.prod, config.cards).solveAll();
+	if (solutions.empty())
+		cout << "> The problem has no exact solution, the experiments can only get close.\n";
+	else
+		cout << "> The problem has " << solutions.size() << " exact solution(s).\n";
+
+	// the experiments run in parallel on every core
+	BatchRunner runner = BatchRunner(config, 0);
+	BatchReport report = runner.run(numberOfExperiments, sel4 == 1);
+
+	if (output == OUTPUT_CONSOLE || output == OUTPUT_BOTH)
+		BatchRunner::writeReport(report, cout);
+
+	if (output == OUTPUT_CSV || output == OUTPUT_BOTH) {
+		std::ofstream outfile("output.csv", std::ofstream::out | std::ofstream::trunc);
+		BatchRunner::writeReport(report, outfile);
+	}
 
 	cout << "> Execution ended!\n";
-	cout << "> Median time of experiment: " << dur/numberOfExperiments << " ms\n";
+	cout << "> Median time of experiment: " << report.avgWallTimeMs << " ms\n";
+	cout << "> Total time: " << report.totalWallTimeMs << " ms\n";
 	cout << "> Program will return to main screen now.\n";
 	waitUserInput();
 }
@@ -287,21 +289,27 @@ int main() {
 
 		auto output = static_cast<OutputChoice>(sel2);
 
-		if (sel1 == 1) {
-			CardGenAlgo cga = CardGenAlgo(popsize, pxover, pmut, maxgens, output, dispFreq);
+		if (sel3 == 2) {
+			ExperimentConfig config = ExperimentConfig();
+			if (sel1 != 1) {
+				config.sum = sum;
+				config.prod = prod;
+				config.cards = cards;
+			}
+			config.popSize = popsize;
+			config.pXOver = pxover;
+			config.pMutation = pmut;
+			config.maxGenerations = maxgens;
 
-			if (sel3 == 1)
-				manualRun(cga);
-			else
-				automatedRun(cga);
+			automatedRun(config, output);
+		}
+		else if (sel1 == 1) {
+			CardGenAlgo cga = CardGenAlgo(popsize, pxover, pmut, maxgens, output, dispFreq);
+			manualRun(cga);
 		}
 		else {
 			CardGenAlgo cga = CardGenAlgo(sum, prod, cards, popsize, pxover, pmut, maxgens, output, dispFreq);
-
-			if (sel3 == 1)
-				manualRun(cga);
-			else
-				automatedRun(cga);
+			manualRun(cga);
 		}
 
 		clearSCR();
@@ -0,0 +1,150 @@
+// Microbenchmark of the operators of a generation: times evaluate, select, crossover and mutate separately
+// over a grid of population sizes and card ranges (the 16 and 32 card word boundaries among them), and counts
+// the heap allocations of every generation.
+//
+// The target sum is unreachable so no run stops early. The results go to stdout as JSON (one object per
+// grid point), a readable table goes to stderr.
+//
+// Usage: OperatorBench [maxPopSize [threads]]     (maxPopSize defaults to 1000000, clamped to 100..10000000)
+// Build: make -C bench (see bench/Makefile)
+#include <iostream>
+#include <iomanip>
+#include <atomic>
+#include <cstdlib>
+#include <new>
+
+#include "../CardGenAlgo.h"
+#include "../Timing.h"
+
+using namespace std;
+
+// every grid point processes about this many genotypes (generations * population size)
+const double GENOTYPE_BUDGET = 2e7;
+const int MIN_GENERATIONS = 5;
+
+// every allocation of the process goes through here
+static std::atomic<long> allocations(0);
+
+void* operator new(size_t size) {
+	allocations++;
+	void* p = malloc(size ? size : 1);
+	if (!p)
+		throw std::bad_alloc();
+	return p;
+}
+
+void operator delete(void* p) noexcept { free(p); }
+void operator delete(void* p, size_t) noexcept { free(p); }
+
+// the time of each phase of a generation, in ns per genotype
+struct PhaseTimes
+{
+	double evaluate, select, crossover, mutate;
+	double allocsPerGeneration;
+	int generations;
+};
+
+class OperatorBench {
+  /*
+   * Drives the phases of a CardGenAlgo generation one at a time (it is a friend of the class).
+   */
+
+public:
+	static PhaseTimes run(int popSize, int cards, int threads) {
+
+		PhaseTimes times = { 0, 0, 0, 0, 0, 0 };
+		int generations = (int)(GENOTYPE_BUDGET / popSize);
+		if (generations < MIN_GENERATIONS)
+			generations = MIN_GENERATIONS;
+
+		GAOptions options;
+		options.seed = 1;
+		options.threads = threads;
+
+		// a sum of 100000 is out of reach with 64 cards
+		CardGenAlgo cga = CardGenAlgo(100000, 360, cards, popSize, 0.6, 0.01, generations + 2, OUTPUT_NONE, generations + 2, options);
+
+		// the first generation scores the whole random population
+		for (int g = 0; g < 2; ++g) {
+			cga.evaluate();
+			cga.select();
+			cga.crossover();
+			cga.mutate();
+		}
+
+		long long ns[4] = { 0, 0, 0, 0 };
+		long before = allocations;
+
+		for (int g = 0; g < generations; ++g) {
+			TimeVar t0 = timeNow();
+			cga.evaluate();
+			TimeVar t1 = timeNow();
+			cga.select();
+			TimeVar t2 = timeNow();
+			cga.crossover();
+			TimeVar t3 = timeNow();
+			cga.mutate();
+			TimeVar t4 = timeNow();
+
+			ns[0] += durationNs(t1 - t0);
+			ns[1] += durationNs(t2 - t1);
+			ns[2] += durationNs(t3 - t2);
+			ns[3] += durationNs(t4 - t3);
+		}
+
+		double genotypes = (double)generations * popSize;
+		times.evaluate = ns[0] / genotypes;
+		times.select = ns[1] / genotypes;
+		times.crossover = ns[2] / genotypes;
+		times.mutate = ns[3] / genotypes;
+		times.allocsPerGeneration = (double)(allocations - before) / generations;
+		times.generations = generations;
+
+		return times;
+	}
+};
+
+int main(int argc, char* argv[]) {
+
+	const int MIN_POPSIZE = 100, MAX_POPSIZE = 10000000;
+	int maxPopSize = (argc > 1) ? atoi(argv[1]) : 1000000;
+	int threads = (argc > 2) ? atoi(argv[2]) : 1;
+	const int cardCounts[] = { 10, 16, 20, 32, 40, 64 };
+	const int cardRanges = sizeof(cardCounts) / sizeof(cardCounts[0]);
+
+	// past the largest size the columns no longer fit in memory
+	if (maxPopSize < MIN_POPSIZE)
+		maxPopSize = MIN_POPSIZE;
+	if (maxPopSize > MAX_POPSIZE)
+		maxPopSize = MAX_POPSIZE;
+	if (threads < 1)
+		threads = 1;
+
+	cerr << setw(10) << "popsize" << setw(7) << "cards" << setw(12) << "evaluate" << setw(12) << "select" << setw(12) << "crossover"
+		<< setw(12) << "mutate" << setw(12) << "total" << setw(10) << "allocs" << "   (ns/genotype, allocs/generation)\n";
+
+	cout << "{\n  \"benchmark\": \"OperatorBench\",\n  \"threads\": " << threads << ",\n  \"results\": [";
+
+	bool first = true;
+	for (int popSize = MIN_POPSIZE; popSize <= maxPopSize; popSize *= 10) {
+		for (int c = 0; c < cardRanges; ++c) {
+			int cards = cardCounts[c];
+			PhaseTimes t = OperatorBench::run(popSize, cards, threads);
+			double total = t.evaluate + t.select + t.crossover + t.mutate;
+
+			cerr << setw(10) << popSize << setw(7) << cards << setw(12) << t.evaluate << setw(12) << t.select << setw(12) << t.crossover
+				<< setw(12) << t.mutate << setw(12) << total << setw(10) << t.allocsPerGeneration << "\n";
+
+			cout << (first ? "\n" : ",\n");
+			cout << "    {\"popSize\": " << popSize << ", \"cards\": " << cards << ", \"generations\": " << t.generations
+				<< ", \"kernel\": \"" << getEvalKernelName(cards, GAOptions().vectorize) << "\""
+				<< ", \"nsPerGenotype\": {\"evaluate\": " << t.evaluate << ", \"select\": " << t.select << ", \"crossover\": " << t.crossover
+				<< ", \"mutate\": " << t.mutate << ", \"total\": " << total << "}"
+				<< ", \"allocsPerGeneration\": " << t.allocsPerGeneration << "}";
+			first = false;
+		}
+	}
+
+	cout << "\n  ]\n}\n";
+	return 0;
+}
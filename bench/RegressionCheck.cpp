@@ -0,0 +1,341 @@
+// Checks of behaviour the benchmarks cannot see: each one prints its name and OK or FAILED, and the exit status is the
+// number of checks that failed.
+//
+// Build: make -C bench check (see bench/Makefile)
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <string>
+#include <vector>
+
+#include "../CardGenAlgo.h"
+#include "../BatchRunner.h"
+#include "../IslandModel.h"
+#include "../ExactSolver.h"
+
+using namespace std;
+
+static int failures = 0;
+
+// keeps the records of a run, at full precision
+struct RecordingSink : public ReportSink {
+	vector<GenerationRecord> records;
+
+	void begin(const TraceInfo&) {}
+	void write(const GenerationRecord& record) { records.push_back(record); }
+};
+
+static void check(const char* name, bool passed) {
+	cout << (passed ? "OK      " : "FAILED  ") << name << "\n";
+	if (!passed)
+		failures++;
+}
+
+// the rates rise while the population is made of clones and come back down once it is diverse again
+static void checkAdaptiveRates() {
+
+	const int popSize = 100, cards = 16;
+	const double pXOver = 0.6, pMutation = 0.01;
+	GAOptions options;
+	options.seed = 1;
+	options.adaptiveRates = true;
+
+	// 17 is prime, so no genotype ever solves it and every generation runs
+	CardGenAlgo cga(80, 17, cards, popSize, pXOver, pMutation, 1000, OUTPUT_NONE, 1, options);
+
+	// a random population is well above the band
+	cga.advanceNGenerations(1);
+	RunResult random = cga.getResult();
+	check("adaptive rates fall in a random population", random.pXOver < pXOver && random.pMutation < pMutation);
+
+	// clones have no spread at all
+	cga.acceptImmigrants(vector<GeneWord>(popSize, 0x5a5a));
+	cga.advanceNGenerations(1);
+	RunResult clones = cga.getResult();
+	check("adaptive rates rise in a population of clones", clones.pXOver > random.pXOver && clones.pMutation > random.pMutation);
+
+	// and once it is random again they fall
+	vector<GeneWord> genes(popSize);
+	RandomGenerator rng(7);
+	for (int i = 0; i < popSize; ++i)
+		genes[i] = rng.next();
+	cga.acceptImmigrants(genes);
+	cga.advanceNGenerations(1);
+	RunResult recovered = cga.getResult();
+	check("adaptive rates fall again when the population recovers", recovered.pXOver < clones.pXOver && recovered.pMutation < clones.pMutation);
+
+	// and over a long run of a problem like the real ones the mutation rate finds a level below its bound, instead of
+	// settling on it and turning the search random
+	// (26209 is next to a product of the cards, 26208, but has no factor up to 16)
+	CardGenAlgo longRun(89, 26209, cards, popSize, pXOver, pMutation, 1000, OUTPUT_NONE, 1, options);
+	int atBound = 0;
+	for (int i = 0; i < 500; ++i) {
+		longRun.advanceNGenerations(1);
+		RunResult result = longRun.getResult();
+		if (result.pMutation >= 0.1)
+			atBound++;
+	}
+	check("adaptive mutation rate stays off its upper bound most of the time", atBound < 250);
+
+	// rates that start past their bounds stay there, instead of being pulled back against the step
+	CardGenAlgo low(80, 17, cards, popSize, 0.05, 0.0001, 1000, OUTPUT_NONE, 1, options);
+	low.advanceNGenerations(1);
+	RunResult lowStart = low.getResult();
+	check("adaptive rates below their lower bounds do not rise while they fall", lowStart.pXOver <= 0.05 && lowStart.pMutation <= 0.0001);
+
+	CardGenAlgo high(80, 17, cards, popSize, 0.99, 0.3, 1000, OUTPUT_NONE, 1, options);
+	high.advanceNGenerations(1);
+	high.acceptImmigrants(vector<GeneWord>(popSize, 0x5a5a));
+	RunResult highBefore = high.getResult();
+	high.advanceNGenerations(1);
+	RunResult highStart = high.getResult();
+	check("adaptive rates above their upper bounds do not fall while they rise", highStart.pXOver >= highBefore.pXOver && highStart.pMutation >= highBefore.pMutation);
+}
+
+// the totals of a population of many evaluation blocks are the same to the last bit on any number of threads
+static void checkThreadTotals() {
+
+	vector<GenerationRecord> serial;
+	bool same = true;
+
+	for (int threads = 1; threads <= 8; threads *= 2) {
+		GAOptions options;
+		options.seed = 4;
+		options.threads = threads;
+		std::shared_ptr<RecordingSink> sink = std::make_shared<RecordingSink>();
+		options.reportSink = sink;
+
+		// 26209 has no factor up to 16, so every generation runs
+		CardGenAlgo cga(89, 26209, 16, 50000, 0.6, 0.01, 20, OUTPUT_CSV, 1, options);
+		cga.advanceToFinalGeneration();
+
+		if (threads == 1) {
+			serial = sink->records;
+			continue;
+		}
+
+		same = same && sink->records.size() == serial.size();
+		for (size_t i = 0; same && i < serial.size(); ++i)
+			same = sink->records[i].totalFitness == serial[i].totalFitness && sink->records[i].stdDev == serial[i].stdDev &&
+				sink->records[i].bestGenes == serial[i].bestGenes;
+	}
+
+	check("evaluation totals do not depend on the threads", same);
+}
+
+// a run reads the same fitness from the table as it computes without it
+static void checkFitnessTable() {
+
+	vector<GenerationRecord> records[2];
+	RunResult results[2];
+
+	for (int table = 0; table < 2; ++table) {
+		GAOptions options;
+		options.seed = 6;
+		options.fitnessTable = table != 0;
+		std::shared_ptr<RecordingSink> sink = std::make_shared<RecordingSink>();
+		options.reportSink = sink;
+
+		CardGenAlgo cga(89, 26209, 16, 200, 0.6, 0.01, 200, OUTPUT_CSV, 1, options);
+		cga.advanceToFinalGeneration();
+		records[table] = sink->records;
+		results[table] = cga.getResult();
+	}
+
+	bool same = records[0].size() == records[1].size() && results[0].best.Genes == results[1].best.Genes &&
+		results[0].best.fitness == results[1].best.fitness && results[0].best.sum == results[1].best.sum &&
+		results[0].best.product == results[1].best.product;
+	for (size_t i = 0; same && i < records[0].size(); ++i)
+		same = records[0][i].totalFitness == records[1][i].totalFitness && records[0][i].stdDev == records[1][i].stdDev &&
+			records[0][i].bestFitness == records[1][i].bestFitness;
+
+	check("the fitness table reports the same values as the arithmetic", same);
+}
+
+// the experiments of a batch run one after the other on the same table, instead of building it again for each one
+static void checkBatchTable() {
+
+	ExperimentConfig config;
+	config.sum = 89;
+	config.prod = 26209;
+	config.cards = 16;
+	config.maxGenerations = 20;
+	config.options.seed = 8;
+	config.options.fitnessTable = true;
+
+	BatchRunner runner(config, 1);
+	std::weak_ptr<const FitnessTable> table = FitnessTable::get(config.sum, config.prod, config.cards, "");
+	runner.run(3, false);
+	std::shared_ptr<const FitnessTable> after = FitnessTable::get(config.sum, config.prod, config.cards, "");
+
+	check("a batch keeps one fitness table for all its experiments", !table.expired() && table.lock() == after);
+}
+
+// an experiment restarted on the same population runs like a new run with its seed and that population
+static void checkRestart() {
+
+	GAOptions options;
+	options.seed = 9;
+
+	CardGenAlgo restarted(89, 26209, 16, 200, 0.6, 0.01, 50, OUTPUT_NONE, 1, options);
+	restarted.advanceToFinalGeneration();
+	restarted.restartSimulation(true);
+	restarted.advanceToFinalGeneration();
+	RunResult second = restarted.getResult();
+
+	options.seed = 10;
+	options.populationSeed = 9;
+	CardGenAlgo fresh(89, 26209, 16, 200, 0.6, 0.01, 50, OUTPUT_NONE, 1, options);
+	fresh.advanceToFinalGeneration();
+	RunResult expected = fresh.getResult();
+
+	check("a restart on the same population runs with the seed of its experiment", second.seed == 10 && second.populationSeed == 9 &&
+		second.best.Genes == expected.best.Genes && second.best.fitness == expected.best.fitness && second.evaluations == expected.evaluations);
+}
+
+static string readFile(const string& path) {
+	std::ifstream file(path.c_str(), std::ifstream::binary);
+	return string(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+}
+
+// a run stopped 5 generations past its last checkpoint and resumed ends with the same best genotype and the same trace
+// as a run that was never stopped, even when it is resumed with other options
+static void checkCheckpoint(TraceFormat format, const char* name) {
+
+	GAOptions options;
+	options.seed = 11;
+	options.replacement = REPLACEMENT_STEADY_STATE;
+	options.elitism = 2;
+	options.replacements = 4;
+	options.adaptiveRates = true;
+	options.traceFormat = format;
+	options.outputPath = "check_trace";
+	options.checkpointPath = "check_trace.ckpt";
+	options.checkpointInterval = 10;
+
+	RunResult expected, result;
+	string expectedTrace;
+	{
+		CardGenAlgo whole(89, 26209, 16, 100, 0.6, 0.01, 40, OUTPUT_CSV, 1, options);
+		whole.advanceToFinalGeneration();
+		expected = whole.getResult();
+	}
+	expectedTrace = readFile(options.outputPath);
+	std::remove(options.checkpointPath.c_str());
+
+	{
+		CardGenAlgo stopped(89, 26209, 16, 100, 0.6, 0.01, 40, OUTPUT_CSV, 1, options);
+		stopped.advanceNGenerations(15);
+	}
+
+	GAOptions resumeOptions;
+	resumeOptions.seed = 11;
+	resumeOptions.traceFormat = format;
+	resumeOptions.outputPath = options.outputPath;
+	resumeOptions.checkpointPath = options.checkpointPath;
+	resumeOptions.checkpointInterval = 10;
+	resumeOptions.resume = true;
+	{
+		CardGenAlgo resumed(89, 26209, 16, 100, 0.6, 0.01, 40, OUTPUT_CSV, 1, resumeOptions);
+		resumed.advanceToFinalGeneration();
+		result = resumed.getResult();
+	}
+
+	bool same = result.generations == expected.generations && result.best.Genes == expected.best.Genes &&
+		result.best.fitness == expected.best.fitness && result.evaluations == expected.evaluations;
+
+	check(name, same && readFile(options.outputPath) == expectedTrace);
+	std::remove(options.outputPath.c_str());
+	std::remove(options.checkpointPath.c_str());
+}
+
+// an island model with a fixed seed solves the problem the same way on any number of threads
+static void checkIslands() {
+
+	ExperimentConfig config;
+	config.sum = 89;
+	config.prod = 26208;
+	config.cards = 16;
+	config.maxGenerations = 500;
+	config.options.seed = 7;
+
+	IslandOptions islandOptions;
+	islandOptions.islands = 4;
+	islandOptions.migrationInterval = 20;
+	islandOptions.migrants = 3;
+
+	RunResult results[2];
+	for (int run = 0; run < 2; ++run) {
+		islandOptions.threads = (run == 0) ? 1 : 4;
+		IslandModel model(config, islandOptions);
+		model.advanceToFinalGeneration();
+		results[run] = model.getResult();
+	}
+
+	check("an island model with a fixed seed solves the problem the same way on 1 and 4 threads", results[0].solved &&
+		results[1].solved && results[0].generations == results[1].generations && results[0].best.Genes == results[1].best.Genes);
+}
+
+// the exact solver finds the same solutions as trying every genotype, from 2 to 14 cards, for the targets of a few
+// genotypes (so that there are solutions), the same targets moved off by one and the empty stacks
+static void checkExactSolver() {
+
+	bool same = true;
+	RandomGenerator rng(12);
+
+	for (int cards = 2; cards <= 14; ++cards) {
+		GeneWord all = ((GeneWord)1 << cards) - 1;
+		vector<GeneWord> seeds = { 0, all, 1, (GeneWord)1 << (cards - 1) };
+		for (int i = 0; i < 4; ++i)
+			seeds.push_back(rng.next() & all);
+
+		for (size_t t = 0; t < 2 * seeds.size(); ++t) {
+			// the sum of the first stack and the product of the second (0 when it is empty)
+			int sum = 0;
+			int64_t prod = 0;
+			for (int j = 0; j < cards; ++j) {
+				if ((seeds[t / 2] >> j) & 1)
+					prod = (prod == 0) ? j + 1 : prod * (j + 1);
+				else
+					sum += j + 1;
+			}
+			if (t % 2 == 1)
+				prod++;
+
+			vector<GeneWord> expected;
+			for (GeneWord genes = 0; genes <= all; ++genes) {
+				int genesSum = 0;
+				int64_t genesProd = 0;
+				for (int j = 0; j < cards; ++j) {
+					if ((genes >> j) & 1)
+						genesProd = (genesProd == 0) ? j + 1 : genesProd * (j + 1);
+					else
+						genesSum += j + 1;
+				}
+				if (genesSum == sum && genesProd == prod)
+					expected.push_back(genes);
+			}
+
+			same = same && ExactSolver(sum, prod, cards).solveAll() == expected;
+		}
+	}
+
+	check("the exact solver finds every solution and nothing else from 2 to 14 cards", same);
+}
+
+int main() {
+
+	checkAdaptiveRates();
+	checkThreadTotals();
+	checkFitnessTable();
+	checkBatchTable();
+	checkRestart();
+	checkIslands();
+	checkExactSolver();
+	checkCheckpoint(TRACE_TEXT, "a resumed run writes the same text trace as one that was not stopped");
+	checkCheckpoint(TRACE_BINARY, "a resumed run writes the same binary trace as one that was not stopped");
+
+	cout << failures << " check(s) failed\n";
+	return failures;
+}
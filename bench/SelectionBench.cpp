@@ -0,0 +1,117 @@
+// Benchmark of the selection methods: times whole generations for growing population sizes.
+//
+// Crossover and mutation probabilities are tiny and the target has no exact solution, so after
+// the first generation the evaluation is just a pass over the cached fitness and the time per
+// generation is dominated by selection. It also counts the heap allocations of the timed
+// generations, and of generations of every selection method with elitism and steady-state
+// replacement on 1 and 4 threads, which should be zero once the population is set up, and
+// exits with 1 if they are not.
+//
+// Build: make -C bench SelectionBench (see bench/Makefile)
+#include <iostream>
+#include <iomanip>
+#include <atomic>
+#include <cstdlib>
+#include <new>
+
+#include "../CardGenAlgo.h"
+#include "../Timing.h"
+
+using namespace std;
+
+const int GENERATIONS = 10;
+
+// every allocation of the process goes through here
+static std::atomic<long> allocations(0);
+
+void* operator new(size_t size) {
+	allocations++;
+	void* p = malloc(size ? size : 1);
+	if (!p)
+		throw std::bad_alloc();
+	return p;
+}
+
+void operator delete(void* p) noexcept { free(p); }
+void operator delete(void* p, size_t) noexcept { free(p); }
+
+// returns the average time of a generation in ns, and the allocations of the timed generations
+double timeGenerations(SelectionMethod method, int popSize, long& allocs) {
+	GAOptions options;
+	options.selection = method;
+
+	// sum 1000 is unreachable with 10 cards so the run never stops early
+	CardGenAlgo cga = CardGenAlgo(1000, 360, 10, popSize, 0.0001, 0.0001, GENERATIONS + 1, OUTPUT_NONE, GENERATIONS + 1, options);
+
+	// the first generation scores the whole random population
+	cga.advanceNGenerations(1);
+
+	long before = allocations;
+	TimeVar now = timeNow();
+	cga.advanceNGenerations(GENERATIONS);
+	double ns = (double)durationNs(timeNow() - now) / GENERATIONS;
+	allocs = allocations - before;
+	return ns;
+}
+
+// returns the allocations of generations that go through every operator, after the first one
+long countAllocations(SelectionMethod method, ReplacementMode replacement, int elitism, int threads) {
+	GAOptions options;
+	options.selection = method;
+	options.replacement = replacement;
+	options.elitism = elitism;
+	options.threads = threads;
+
+	CardGenAlgo cga = CardGenAlgo(1000, 360, 10, 10000, 0.6, 0.01, GENERATIONS + 1, OUTPUT_NONE, GENERATIONS + 1, options);
+	cga.advanceNGenerations(1);
+
+	long before = allocations;
+	cga.advanceNGenerations(GENERATIONS);
+	return allocations - before;
+}
+
+int main() {
+
+	const char* names[] = { "linear", "binary", "alias", "tournament", "sus", "rank", "truncation" };
+	const int linearLimit = 20000;   // the linear scan is O(N^2) per generation
+	int allocating = 0;
+
+	cout << setw(10) << "popsize" << setw(10) << "method" << setw(16) << "ms/gen" << setw(16) << "ns/genotype" << setw(10) << "allocs" << endl;
+
+	for (int popSize = 1000; popSize <= 1000000; popSize *= 10) {
+		for (int method = SELECTION_ROULETTE_LINEAR; method <= SELECTION_ROULETTE_ALIAS; ++method) {
+			if (method == SELECTION_ROULETTE_LINEAR && popSize > linearLimit)
+				continue;
+
+			long allocs;
+			double ns = timeGenerations(static_cast<SelectionMethod>(method), popSize, allocs);
+			cout << setw(10) << popSize << setw(10) << names[method] << setw(16) << ns / 1e6 << setw(16) << ns / popSize << setw(10) << allocs << endl;
+			if (allocs != 0)
+				allocating++;
+		}
+	}
+
+	cout << endl << setw(10) << "threads" << setw(12) << "method" << setw(16) << "replacement" << setw(10) << "allocs" << endl;
+
+	for (int threads = 1; threads <= 4; threads *= 4) {
+		for (int method = SELECTION_ROULETTE_LINEAR; method <= SELECTION_TRUNCATION; ++method) {
+			const char* replacements[] = { "generational", "elitism", "steady-state" };
+
+			for (int r = 0; r < 3; ++r) {
+				long allocs = countAllocations(static_cast<SelectionMethod>(method), (r == 2) ? REPLACEMENT_STEADY_STATE : REPLACEMENT_GENERATIONAL,
+					(r == 1) ? 2 : 0, threads);
+				cout << setw(10) << threads << setw(12) << names[method] << setw(16) << replacements[r] << setw(10) << allocs << endl;
+				if (allocs != 0)
+					allocating++;
+			}
+		}
+	}
+
+	// a generation that allocates is a regression, and fails the run
+	if (allocating > 0) {
+		cerr << allocating << " configuration(s) allocated during the timed generations" << endl;
+		return 1;
+	}
+
+	return 0;
+}
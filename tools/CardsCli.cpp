@@ -0,0 +1,317 @@
+// Non-interactive driver: runs a batch of experiments, a sweep over a grid of parameters, or a batch of island
+// models, on every core and writes one aggregated result file.
+//
+// Usage: CardsCli [--config <file>] [--<key>=<value> | --<key> <value>]...
+//
+// The config file has one "key = value" per line ('#' starts a comment), flags override it.
+//   sum, prod, cards                   the problem (default 36, 360, 10)
+//   popSize, pXOver, pMutation,        the algorithm, each one a value, a list "a,b,c" or an inclusive
+//   maxGenerations                     range "from:to[:step]" (a sweep runs every combination)
+//   experiments                        experiments per point (default 20)
+//   samePopulation                     1 to start every experiment of a point from the same population
+//   threads                            experiments running at the same time (default 0, every core)
+//   seed                               the base seed (default 0, from the clock)
+//   selection                          roulette-linear, roulette-binary, roulette-alias, tournament, sus, rank, truncation
+//   mutation                           per-gene, geometric, word-mask
+//   adaptiveRates                      1 to move pXOver and pMutation with the spread of the fitness
+//   diversityLow, diversityHigh        the band of the coefficient of variation of the fitness they keep (default 1, 2)
+//   replacement                        generational, steady-state
+//   elitism                            the fittest genotypes kept unchanged every generation (generational)
+//   replacements                       the least fit genotypes replaced at every step (steady-state)
+//   stallGenerations                   stop a run when its best fitness has not improved for this many generations
+//   minStdDev                          stop a run when the standard deviation of its fitness falls below this
+//   timeBudgetMs, evaluationBudget     stop a run when it has taken this long or scored this many genotypes (each 0, never)
+//   productMode                        int64, int128, log
+//   fitnessTable                       1 to look the fitness up in a table (up to 26 cards)
+//   output                             the result file (default results.csv, "-" for stdout)
+//   runs                               1 to list every experiment as well (only without a sweep)
+//   islands                            run every experiment as an island model of this many populations of popSize
+//                                      (default 0, none; only without a sweep)
+//   migrationInterval, migrants        the generations between migrations and the genotypes an island sends (default 20, 2)
+//   topology                           ring, random
+//   checkpoint                         save the experiments to <checkpoint>.<point>.<experiment> as they run
+//   checkpointInterval                 the generations between checkpoints (default 0, only when an experiment ends)
+//   resume                             1 to resume the experiments from their checkpoints
+//
+// Build: make -C tools (see tools/Makefile)
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <map>
+#include <stdexcept>
+#include <cstdlib>
+
+#include "../SweepRunner.h"
+#include "../IslandModel.h"
+#include "../ExactSolver.h"
+#include "../Timing.h"
+
+using namespace std;
+
+typedef map<string, string> Settings;
+
+static string trim(const string& text) {
+	size_t first = text.find_first_not_of(" \t\r\n");
+	size_t last = text.find_last_not_of(" \t\r\n");
+	return (first == string::npos) ? "" : text.substr(first, last - first + 1);
+}
+
+// read the "key = value" lines of a config file into settings
+static void readConfig(const string& path, Settings& settings) {
+
+	ifstream file(path.c_str());
+	string line;
+	int lineNumber = 0;
+
+	if (!file)
+		throw invalid_argument("Could not open " + path);
+
+	while (getline(file, line)) {
+		lineNumber++;
+
+		size_t comment = line.find('#');
+		if (comment != string::npos)
+			line = line.substr(0, comment);
+
+		line = trim(line);
+		if (line.empty())
+			continue;
+
+		size_t equals = line.find('=');
+		if (equals == string::npos) {
+			ostringstream message;
+			message << path << ":" << lineNumber << ": expected key = value";
+			throw invalid_argument(message.str());
+		}
+
+		settings[trim(line.substr(0, equals))] = trim(line.substr(equals + 1));
+	}
+}
+
+static double parseDouble(const string& key, const string& text) {
+	char* end;
+	double value = strtod(text.c_str(), &end);
+	if (text.empty() || *end != '\0')
+		throw invalid_argument("Bad value for " + key + ": " + text);
+	return value;
+}
+
+static long long parseInt(const string& key, const string& text) {
+	char* end;
+	long long value = strtoll(text.c_str(), &end, 10);
+	if (text.empty() || *end != '\0')
+		throw invalid_argument("Bad value for " + key + ": " + text);
+	return value;
+}
+
+// a value, a list "a,b,c" or an inclusive range "from:to[:step]" (the step defaults to 1)
+static vector<double> parseValues(const string& key, const string& text) {
+
+	vector<double> values;
+
+	size_t colon = text.find(':');
+	if (colon != string::npos) {
+		size_t second = text.find(':', colon + 1);
+
+		double from = parseDouble(key, text.substr(0, colon));
+		double to = parseDouble(key, text.substr(colon + 1, (second == string::npos) ? string::npos : second - colon - 1));
+		double step = (second == string::npos) ? 1 : parseDouble(key, text.substr(second + 1));
+		if (step <= 0 || to < from)
+			throw invalid_argument("Bad range for " + key + ": " + text);
+
+		// counted in steps so that rounding does not drop the last value
+		long long steps = (long long)((to - from) / step + 1e-9);
+		for (long long i = 0; i <= steps; ++i)
+			values.push_back(from + i * step);
+		return values;
+	}
+
+	stringstream list(text);
+	string item;
+	while (getline(list, item, ','))
+		values.push_back(parseDouble(key, trim(item)));
+
+	return values;
+}
+
+static vector<int> toInts(const vector<double>& values) {
+	vector<int> ints;
+	for (size_t i = 0; i < values.size(); ++i)
+		ints.push_back((int)(values[i] + 0.5));
+	return ints;
+}
+
+// the index of name in names
+static int parseChoice(const string& key, const string& name, const char* const names[], int count) {
+	for (int i = 0; i < count; ++i)
+		if (name == names[i])
+			return i;
+	throw invalid_argument("Bad value for " + key + ": " + name);
+}
+
+// run experiments 1..experiments of the single point of sweep as island models, one after the other
+// (the islands of a model are spread over the threads, experiment n is seeded with seed + n - 1 as in a batch)
+static BatchReport runIslands(const SweepConfig& sweep, const IslandOptions& islandOptions, int experiments) {
+
+	vector<ExperimentConfig> points = sweep.grid();
+	if (points.size() != 1)
+		throw invalid_argument("The island model runs without a sweep");
+
+	ExperimentConfig config = BatchRunner::batchConfig(points[0]);
+	BatchReport report = BatchReport();
+	TimeVar now = timeNow();
+
+	for (int experiment = 1; experiment <= experiments; ++experiment) {
+		ExperimentConfig islandConfig = config;
+		islandConfig.options.seed = config.options.seed + experiment - 1;
+		if (!islandConfig.options.checkpointPath.empty())
+			islandConfig.options.checkpointPath += "." + std::to_string(experiment);
+
+		IslandModel model(islandConfig, islandOptions);
+		model.advanceToFinalGeneration();
+		report.runs.push_back(model.getResult());
+		report.runs.back().experiment = experiment;
+	}
+
+	report.totalWallTimeMs = durationMs(timeNow() - now);
+	BatchRunner::summarize(report);
+	return report;
+}
+
+int main(int argc, char* argv[]) {
+
+	Settings settings;
+	const char* const selections[] = { "roulette-linear", "roulette-binary", "roulette-alias", "tournament", "sus", "rank", "truncation" };
+	const char* const mutations[] = { "per-gene", "geometric", "word-mask" };
+	const char* const productModes[] = { "int64", "int128", "log" };
+	const char* const replacementModes[] = { "generational", "steady-state" };
+	const char* const topologies[] = { "ring", "random" };
+
+	try {
+		// the config file first, so that the flags override it
+		Settings flags;
+		for (int i = 1; i < argc; ++i) {
+			string arg = argv[i];
+			if (arg.compare(0, 2, "--") != 0)
+				throw invalid_argument("Unexpected argument: " + arg);
+
+			arg = arg.substr(2);
+			size_t equals = arg.find('=');
+			if (equals != string::npos)
+				flags[arg.substr(0, equals)] = arg.substr(equals + 1);
+			else if (i + 1 < argc)
+				flags[arg] = argv[++i];
+			else
+				throw invalid_argument("Missing value for --" + arg);
+		}
+
+		if (flags.count("config"))
+			readConfig(flags["config"], settings);
+		for (Settings::iterator it = flags.begin(); it != flags.end(); ++it)
+			settings[it->first] = it->second;
+		settings.erase("config");
+
+		SweepConfig sweep;
+		ExperimentConfig& base = sweep.base;
+		IslandOptions islandOptions;
+		islandOptions.islands = 0;
+		int experiments = 20, threads = 0;
+		bool samePopulation = false, listRuns = false;
+		string output = "results.csv";
+
+		for (Settings::iterator it = settings.begin(); it != settings.end(); ++it) {
+			const string& key = it->first;
+			const string& value = it->second;
+
+			if (key == "sum") base.sum = (int)parseInt(key, value);
+			else if (key == "prod") base.prod = parseInt(key, value);
+			else if (key == "cards") base.cards = (int)parseInt(key, value);
+			else if (key == "popSize") sweep.popSizes = toInts(parseValues(key, value));
+			else if (key == "pXOver") sweep.pXOvers = parseValues(key, value);
+			else if (key == "pMutation") sweep.pMutations = parseValues(key, value);
+			else if (key == "maxGenerations") sweep.maxGenerations = toInts(parseValues(key, value));
+			else if (key == "experiments") experiments = (int)parseInt(key, value);
+			else if (key == "samePopulation") samePopulation = parseInt(key, value) != 0;
+			else if (key == "threads") threads = (int)parseInt(key, value);
+			else if (key == "seed") base.options.seed = (uint64_t)parseInt(key, value);
+			else if (key == "selection") base.options.selection = (SelectionMethod)parseChoice(key, value, selections, 7);
+			else if (key == "mutation") base.options.mutation = (MutationMethod)parseChoice(key, value, mutations, 3);
+			else if (key == "adaptiveRates") base.options.adaptiveRates = parseInt(key, value) != 0;
+			else if (key == "diversityLow") base.options.diversityLow = parseDouble(key, value);
+			else if (key == "diversityHigh") base.options.diversityHigh = parseDouble(key, value);
+			else if (key == "replacement") base.options.replacement = (ReplacementMode)parseChoice(key, value, replacementModes, 2);
+			else if (key == "elitism") base.options.elitism = (int)parseInt(key, value);
+			else if (key == "replacements") base.options.replacements = (int)parseInt(key, value);
+			else if (key == "stallGenerations") base.options.stallGenerations = (int)parseInt(key, value);
+			else if (key == "minStdDev") base.options.minStdDev = parseDouble(key, value);
+			else if (key == "timeBudgetMs") base.options.timeBudgetMs = parseDouble(key, value);
+			else if (key == "evaluationBudget") base.options.evaluationBudget = (uint64_t)parseInt(key, value);
+			else if (key == "productMode") base.options.productMode = (ProductMode)parseChoice(key, value, productModes, 3);
+			else if (key == "fitnessTable") base.options.fitnessTable = parseInt(key, value) != 0;
+			else if (key == "output") output = value;
+			else if (key == "runs") listRuns = parseInt(key, value) != 0;
+			else if (key == "islands") islandOptions.islands = (int)parseInt(key, value);
+			else if (key == "migrationInterval") islandOptions.migrationInterval = (int)parseInt(key, value);
+			else if (key == "migrants") islandOptions.migrants = (int)parseInt(key, value);
+			else if (key == "topology") islandOptions.topology = (MigrationTopology)parseChoice(key, value, topologies, 2);
+			else if (key == "checkpoint") base.options.checkpointPath = value;
+			else if (key == "checkpointInterval") base.options.checkpointInterval = (int)parseInt(key, value);
+			else if (key == "resume") base.options.resume = parseInt(key, value) != 0;
+			else throw invalid_argument("Unknown setting: " + key);
+		}
+
+		if (experiments < 1)
+			throw invalid_argument("Experiments should be at least 1");
+
+		if (islandOptions.islands < 0)
+			throw invalid_argument("Islands should be positive or 0");
+
+		SweepReport report;
+		BatchReport islandReport;
+		if (islandOptions.islands > 0) {
+			islandOptions.threads = threads;
+			islandReport = runIslands(sweep, islandOptions, experiments);
+		} else {
+			SweepRunner runner(sweep, threads);
+			report = runner.run(experiments, samePopulation);
+		}
+
+		ofstream file;
+		if (output != "-") {
+			file.open(output.c_str(), ofstream::out | ofstream::trunc);
+			if (!file)
+				throw invalid_argument("Could not open " + output + " for writing");
+		}
+		ostream& out = (output == "-") ? cout : file;
+
+		// whether the problem can be solved at all, as a reference for the solved ratios
+		if (base.cards <= 40)
+			out << "# exact solutions: " << ExactSolver(base.sum, base.prod, base.cards).solveAll().size() << "\n";
+
+		if (islandOptions.islands > 0) {
+			out << "# islands: " << islandOptions.islands << ", migration interval: " << islandOptions.migrationInterval << ", migrants: "
+				<< islandOptions.migrants << ", topology: " << topologies[islandOptions.topology] << "\n";
+			BatchRunner::writeReport(islandReport, out);
+			cerr << "> " << experiments << " island model(s) of " << islandOptions.islands << " island(s), " << islandReport.totalWallTimeMs << " ms\n";
+		} else {
+			SweepRunner::writeReport(report, out);
+			if (listRuns && report.batches.size() == 1)
+				BatchRunner::writeReport(report.batches[0], out);
+
+			cerr << "> " << report.points.size() << " point(s), " << experiments << " experiment(s) each, " << report.totalWallTimeMs << " ms\n";
+		}
+	}
+	catch (const invalid_argument& e) {
+		cerr << e.what() << "\n";
+		return 1;
+	}
+	catch (const invalid_argument* e) {
+		// the constructors of CardGenAlgo throw pointers
+		cerr << e->what() << "\n";
+		delete e;
+		return 1;
+	}
+
+	return 0;
+}
@@ -0,0 +1,71 @@
+// Reader/converter of the binary traces written with GAOptions::traceFormat = TRACE_BINARY.
+//
+// Usage: TraceTool <trace>                  prints the problem and a summary of the experiments
+//        TraceTool <trace> <output.csv>     converts the trace to the text format ("-" for stdout)
+//
+// Build: make -C tools TraceTool (see tools/Makefile)
+#include <iostream>
+#include <stdexcept>
+#include <string>
+
+#include "../TraceFile.h"
+
+using namespace std;
+
+// print the problem and, for every experiment, its generations and its best genotype
+void summarize(const TraceReader& trace) {
+	const TraceHeader& h = trace.header();
+
+	cout << "Cards: " << h.cards << ", target sum: " << h.sum << ", target product: " << h.product << "\n";
+	cout << "Population: " << h.popSize << ", seed: " << h.seed << "\n";
+	cout << "Records: " << trace.size() << ", blocks: " << trace.blocks() << "\n";
+
+	int experiments = 0, solved = 0;
+	size_t b = 0;
+	while (b < trace.blocks()) {
+		// the blocks of an experiment are contiguous and the last one holds its final generation
+		size_t last = b;
+		while (last + 1 < trace.blocks() && trace.block(last + 1).experiment == trace.block(b).experiment)
+			++last;
+
+		++experiments;
+		if (trace.block(last).bestSum == h.sum && trace.block(last).bestProduct == h.product)
+			++solved;
+
+		b = last + 1;
+	}
+
+	cout << "Experiments: " << experiments << ", solved: " << solved << "\n";
+}
+
+int main(int argc, char* argv[]) {
+
+	if (argc != 2 && argc != 3) {
+		cerr << "Usage: " << argv[0] << " <trace> [<output.csv> | -]\n";
+		return 1;
+	}
+
+	try {
+		TraceReader trace(argv[1]);
+
+		if (argc == 2) {
+			summarize(trace);
+			return 0;
+		}
+
+		string output = argv[2];
+		if (output == "-") {
+			CsvReportSink sink("/dev/stdout");
+			trace.exportTo(sink);
+		} else {
+			CsvReportSink sink(output);
+			trace.exportTo(sink);
+		}
+	}
+	catch (const std::invalid_argument& e) {
+		cerr << e.what() << "\n";
+		return 1;
+	}
+
+	return 0;
+}